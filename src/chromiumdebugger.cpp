@@ -4,6 +4,8 @@
 #include <QMessageBox>
 #include <QNetworkRequest>
 #include <QNetworkReply>
+#include <QJsonArray>
+#include <QTimer>
 #include <QWebSocket>
 
 ChromiumDebugger::ChromiumDebugger(QObject *parent) :
@@ -13,11 +15,17 @@ ChromiumDebugger::ChromiumDebugger(QObject *parent) :
     connect(ws, &QWebSocket::textMessageReceived, this, &ChromiumDebugger::onReceived);
     connect(ws, &QWebSocket::connected, this, &ChromiumDebugger::onConnected);
     connect(ws, &QWebSocket::disconnected, this, &ChromiumDebugger::onDisconnected);
+    next_id = 1;
+    clock.start();
+    timeoutTimer = new QTimer(this);
+    timeoutTimer->setInterval(1000);
+    connect(timeoutTimer, &QTimer::timeout, this, &ChromiumDebugger::checkTimeouts);
 }
 
 // establish connection
-void ChromiumDebugger::open(int port)
+void ChromiumDebugger::open(int port, const QString &targetUrl)
 {
+    this->targetUrl = targetUrl;
     QString addr = "http://localhost:" + QString::number(port) + "/json";
     reply = access_manager->get(QNetworkRequest(addr));
     connect(reply, &QNetworkReply::finished, this, &ChromiumDebugger::onDebugInfoReceived);
@@ -27,38 +35,117 @@ void ChromiumDebugger::onDebugInfoReceived()
 {
     if (reply->error() == QNetworkReply::NoError)
     {
-        QString url = QJsonDocument::fromJson(reply->readAll()).toVariant().toList()[0].toHash()["webSocketDebuggerUrl"].toString();
-        ws->open(QUrl(url));
+        // find the page to debug
+        QJsonArray targets = QJsonDocument::fromJson(reply->readAll()).array();
+        QString url;
+        foreach (QJsonValue item, targets)
+        {
+            QJsonObject target = item.toObject();
+            if (targetUrl.isEmpty() || target["url"].toString() == targetUrl)
+            {
+                url = target["webSocketDebuggerUrl"].toString();
+                break;
+            }
+        }
+        if (url.isEmpty())
+            QMessageBox::warning(nullptr, "Error", "Fails to find the page in Chromium!");
+        else
+            ws->open(QUrl(url));
     }
     else
         QMessageBox::warning(nullptr, "Error", "Fails to get Chromium's debug info!");
     reply->deleteLater();
 }
 
-void ChromiumDebugger::send(int id, const QString &method, const QVariantHash &params)
+int ChromiumDebugger::call(const QString &method, const QJsonObject &params, const Callback &callback, int timeout)
 {
-    QVariantHash data;
+    int id = next_id++;
+    QJsonObject data;
     data["id"] = id;
     data["method"] = method;
     data["params"] = params;
-    QByteArray jsonData = QJsonDocument::fromVariant(data).toJson(QJsonDocument::Compact);
+    QByteArray jsonData = QJsonDocument(data).toJson(QJsonDocument::Compact);
     ws->sendTextMessage(QString::fromUtf8(jsonData));
+
+    // wait for the result
+    PendingCall pending;
+    pending.callback = callback;
+    pending.deadline = clock.elapsed() + timeout;
+    pendingCalls[id] = pending;
+    if (!timeoutTimer->isActive())
+        timeoutTimer->start();
+    return id;
+}
+
+void ChromiumDebugger::checkTimeouts()
+{
+    qint64 now = clock.elapsed();
+    QList<int> expired;
+    for (auto i = pendingCalls.constBegin(); i != pendingCalls.constEnd(); i++)
+    {
+        if (i.value().deadline <= now)
+            expired << i.key();
+    }
+    foreach (int id, expired)
+    {
+        Callback callback = pendingCalls.take(id).callback;
+        if (callback)
+            callback(QJsonObject(), "Timeout");
+    }
+    if (pendingCalls.isEmpty())
+        timeoutTimer->stop();
+}
+
+void ChromiumDebugger::failAll(const QString &error)
+{
+    QHash<int, PendingCall> calls = pendingCalls;
+    pendingCalls.clear();
+    timeoutTimer->stop();
+    foreach (PendingCall pending, calls)
+    {
+        if (pending.callback)
+            pending.callback(QJsonObject(), error);
+    }
+}
+
+void ChromiumDebugger::setEventFilter(const QStringList &methods)
+{
+    wantedEvents = methods.toSet();
 }
 
 void ChromiumDebugger::onReceived(const QString &message)
 {
-    QVariantHash data = QJsonDocument::fromJson(message.toUtf8()).toVariant().toHash();
-    int id = data["id"].toInt();
+    // Chromium writes events as {"method":"Domain.event","params":{...}},
+    // peek at the name and drop unwanted events before parsing
+    static const QString eventPrefix = "{\"method\":\"";
+    if (!wantedEvents.isEmpty() && message.startsWith(eventPrefix))
+    {
+        int end = message.indexOf('"', eventPrefix.length());
+        if (end != -1 && !wantedEvents.contains(message.mid(eventPrefix.length(), end - eventPrefix.length())))
+            return;
+    }
+
+    // values of QJsonObject are only converted when they are read
+    QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object();
     if (data.contains("method") && data.contains("params")) // event
     {
         QString method = data["method"].toString();
-        QVariantHash params = data["params"].toHash();
-        emit eventReceived(id, method, params);
+        if (!wantedEvents.isEmpty() && !wantedEvents.contains(method))
+            return;
+        emit eventReceived(method, data["params"].toObject());
     }
-    else if (data.contains("result")) // return of a call
+    else if (data.contains("id")) // return of a call
     {
-        QVariantHash result = data["result"].toHash();
-        emit resultReceived(id, result);
+        int id = data["id"].toInt();
+        if (!pendingCalls.contains(id)) // timed out
+            return;
+        Callback callback = pendingCalls.take(id).callback;
+        if (!callback)
+            return;
+        if (data.contains("error"))
+            callback(QJsonObject(), data["error"].toObject()["message"].toString());
+        else
+            callback(data["result"].toObject(), QString());
     }
 }
 
@@ -71,4 +158,5 @@ void ChromiumDebugger::onConnected()
 void ChromiumDebugger::onDisconnected()
 {
     qDebug("[ChromiumDebugger] Chromium disconnected");
+    failAll("Chromium disconnected");
 }
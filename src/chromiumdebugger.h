@@ -1,34 +1,59 @@
 #ifndef CHROMIUMDEBUGGER_H
 #define CHROMIUMDEBUGGER_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
 #include <QObject>
-#include <QVariantHash>
+#include <QSet>
+#include <functional>
 class QNetworkReply;
+class QTimer;
 class QWebSocket;
 
-// Communicate with chromium's remote debugger
+/* Communicate with chromium's remote debugger.
+ * Each call gets a new id, and its callback is run when the result with the same id arrives,
+ * or with an error if Chromium reports one, the call times out or the connection is closed.
+ * A debugger is connected to one page, so pages can be debugged at the same time with more instances.
+ */
 class ChromiumDebugger : public QObject
 {
     Q_OBJECT
 public:
+    typedef std::function<void (const QJsonObject &result, const QString &error)> Callback;
+
     ChromiumDebugger(QObject *parent = nullptr);
-    void open(int port);
-    void send(int id, const QString &method, const QVariantHash &params = QVariantHash());
+    void open(int port, const QString &targetUrl = QString()); // connect to the page with the url, or the first page
+    int call(const QString &method, const QJsonObject &params = QJsonObject(),
+             const Callback &callback = Callback(), int timeout = 10000);
+    void setEventFilter(const QStringList &methods);   // only emit these events, all events if empty
 
 signals:
     void connected(void);
-    void eventReceived(int id, const QString &method, const QVariantHash &params);
-    void resultReceived(int id, const QVariantHash &result);
+    void eventReceived(const QString &method, const QJsonObject &params);
 
 private slots:
     void onDebugInfoReceived(void);
     void onConnected(void);
     void onDisconnected(void);
     void onReceived(const QString &message);
+    void checkTimeouts(void);
 
 private:
+    struct PendingCall
+    {
+        Callback callback;
+        qint64 deadline;
+    };
     QWebSocket *ws;
     QNetworkReply *reply;
+    QTimer *timeoutTimer;
+    QElapsedTimer clock;
+    QHash<int, PendingCall> pendingCalls;
+    QSet<QString> wantedEvents;
+    QString targetUrl;
+    int next_id;
+    void failAll(const QString &error);
 };
 
 #endif // CHROMIUMDEBUGGER_H
@@ -1,15 +1,15 @@
 #include "cutterbar.h"
 #include "ui_cutterbar.h"
 #include "utils.h"
-#include "platform/paths.h"
+#include "streammuxer.h"
+#include "thumbnailer.h"
 #include <QDir>
 #include <QMessageBox>
-#include <QProcess>
-#include <QTextCodec>
 
-CutterBar::CutterBar(QWidget *parent) :
+CutterBar::CutterBar(Thumbnailer *thumbnailer, QWidget *parent) :
     QWidget(parent),
-    ui(new Ui::CutterBar)
+    ui(new Ui::CutterBar),
+    thumbnailer(thumbnailer)
 {
     ui->setupUi(this);
     slider_pressed = false;
@@ -21,9 +21,7 @@ CutterBar::CutterBar(QWidget *parent) :
     connect(ui->endSlider, SIGNAL(sliderReleased()), this, SLOT(onSliderReleased()));
     connect(ui->cancelButton, SIGNAL(clicked()), this, SIGNAL(finished()));
     connect(ui->okButton, SIGNAL(clicked()), this, SLOT(startTask()));
-
-    process = new QProcess(this);
-    connect(process, SIGNAL(finished(int)), this, SLOT(onFinished(int)));
+    muxer = nullptr;
 }
 
 CutterBar::~CutterBar()
@@ -40,6 +38,27 @@ void CutterBar::init(QString filename, int length, int currentPos)
     ui->endSlider->setValue(currentPos + 1);
     startPos = currentPos;
     endPos = currentPos + 1;
+    ui->previewLabel->hide();
+    showFrame(currentPos);
+}
+
+/* Show the thumbnail of the position. If the thumbnails are not ready yet,
+ * seek the player instead when the slider is released or moved by keyboard.
+ */
+void CutterBar::showFrame(int pos)
+{
+    if (thumbnailer->currentFile() == filename)
+    {
+        QImage image = thumbnailer->thumbnail(pos);
+        if (!image.isNull())
+        {
+            ui->previewLabel->setPixmap(QPixmap::fromImage(image).scaledToHeight(72, Qt::SmoothTransformation));
+            ui->previewLabel->show();
+            return;
+        }
+    }
+    if (isVisible() && !slider_pressed)
+        emit newFrame(pos);
 }
 
 void CutterBar::onSliderPressed()
@@ -51,36 +70,25 @@ void CutterBar::onStartSliderChanged()
 {
     startPos = pos = ui->startSlider->value();
     ui->startPosLabel->setText(secToTime(pos));
-    //Show preview when the progress is changed by keyboard
-    if (isVisible() && !slider_pressed)
-        emit newFrame(pos);
+    showFrame(pos);
 }
 
 void CutterBar::onEndSliderChanged()
 {
     endPos = pos = ui->endSlider->value();
     ui->endPosLabel->setText(secToTime(pos));
-    if (isVisible() && !slider_pressed)
-        emit newFrame(pos);
+    showFrame(pos);
 }
 
 void CutterBar::onSliderReleased()
 {
     slider_pressed = false;
     //Show preview when the progress is changed by mouse
-    emit newFrame(pos);
+    showFrame(pos);
 }
 
 void CutterBar::startTask()
 {
-    QString ffmpeg = ffmpegFilePath();
-    // Check whether ffmpeg is installed
-    if (ffmpeg.isEmpty())
-    {
-        QMessageBox::warning(this, "Error", tr("Fails to cut video: FFMPEG is not installed."));
-        return;
-    }
-
     if (startPos >= endPos)
     {
         QMessageBox::warning(this, "Error", tr("Time position is not valid."));
@@ -88,18 +96,27 @@ void CutterBar::startTask()
     }
 
     QString new_name = QString("%1_clip.%2").arg(filename.section('.', 0, -2), filename.section('.', -1));
-    QStringList args;
-    args << "-y" << "-ss" << secToTime(startPos) << "-i" << filename <<
-            "-acodec" << "copy" << "-vcodec" << "copy" << "-t" << secToTime(endPos - startPos) << new_name;
     ui->okButton->setEnabled(false);
     ui->cancelButton->setEnabled(false);
-    process->start(ffmpeg, args, QProcess::ReadOnly);
+    muxer = new StreamMuxer(QStringList() << filename, new_name, StreamMuxer::CONCAT, this);
+    muxer->setRange((qint64) startPos * 1000000, (qint64) endPos * 1000000);
+    connect(muxer, &StreamMuxer::progressChanged, this, &CutterBar::onProgressChanged);
+    connect(muxer, &StreamMuxer::done, this, &CutterBar::onFinished);
+    muxer->start();
+}
+
+void CutterBar::onProgressChanged(int percentage)
+{
+    ui->okButton->setText(QString::number(percentage) + '%');
 }
 
 void CutterBar::onFinished(int status)
 {
-    if (status)
-        QMessageBox::critical(this, "FFMPEG ERROR", QTextCodec::codecForLocale()->toUnicode(process->readAllStandardError()));
+    if (status != StreamMuxer::OK)
+        QMessageBox::critical(this, "ERROR", muxer->errorString());
+    muxer->deleteLater();
+    muxer = nullptr;
+    ui->okButton->setText(tr("OK"));
     ui->okButton->setEnabled(true);
     ui->cancelButton->setEnabled(true);
     QMessageBox::information(this, "Finished", tr("Finished"));
@@ -6,14 +6,15 @@
 namespace Ui {
 class CutterBar;
 }
-class QProcess;
+class StreamMuxer;
+class Thumbnailer;
 
 class CutterBar : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit CutterBar(QWidget *parent = 0);
+    explicit CutterBar(Thumbnailer *thumbnailer, QWidget *parent = 0);
     ~CutterBar();
     void init(QString filename, int length, int currentPos);
 
@@ -28,7 +29,10 @@ private:
     int startPos;
     int endPos;
     bool slider_pressed;
-    QProcess *process;
+    StreamMuxer *muxer;
+    Thumbnailer *thumbnailer;
+
+    void showFrame(int pos);
 
 private slots:
     void onStartSliderChanged(void);
@@ -36,6 +40,7 @@ private slots:
     void onSliderPressed(void);
     void onSliderReleased(void);
     void startTask(void);
+    void onProgressChanged(int percentage);
     void onFinished(int status);
 };
 
@@ -1,9 +1,11 @@
 #include "danmakuloader.h"
 #include "accessmanager.h"
+#include "pythonthread.h"
 #include "settings_danmaku.h"
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QDir>
+#include <QFile>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QTimer>
@@ -18,6 +20,27 @@ DanmakuLoader::DanmakuLoader(QObject *parent) : QObject(parent)
 {
     module = danmaku2assFunc = nullptr;
     reply = nullptr;
+    generation = 0;
+    connect(this, &DanmakuLoader::converted, this, &DanmakuLoader::onConverted);
+}
+
+DanmakuLoader::~DanmakuLoader()
+{
+    if (!assFile.isEmpty())
+        QFile::remove(assFile);
+}
+
+// Drop the running load, e.g. when another video is opened
+void DanmakuLoader::cancel()
+{
+    generation++;
+    if (reply)
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+        reply = nullptr;
+    }
 }
 
 void DanmakuLoader::reload()
@@ -27,6 +50,7 @@ void DanmakuLoader::reload()
 
 void DanmakuLoader::load(const QString &xmlFile, int width, int height)
 {
+    generation++;
     this->xmlFile = xmlFile;
     if (height > QApplication::desktop()->height())
     {
@@ -59,22 +83,9 @@ void DanmakuLoader::onXmlDownloaded()
 {
     if (reply->error() == QNetworkReply::NoError)
     {
-        if (danmaku2assFunc == nullptr)
-        {
-            if ((module = PyImport_ImportModule(DANMAKU2ASS)) == nullptr)
-            {
-                printPythonException();
-                exit(EXIT_FAILURE);
-            }
-            if ((danmaku2assFunc = PyObject_GetAttrString(module, "Danmaku2ASS")) == nullptr)
-            {
-                printPythonException();
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        // Output file
-        QByteArray output_file = QDir::temp().filePath("moonplayer_danmaku.ass").toUtf8();
+        // Output file, each load has its own so that a running conversion never overwrites it
+        QByteArray output_file = QDir::temp().filePath(QString("moonplayer_danmaku_%1_%2.ass")
+                                                       .arg(QCoreApplication::applicationPid()).arg(generation)).toUtf8();
 
         // Font
 #ifdef Q_OS_MAC
@@ -111,7 +122,7 @@ void DanmakuLoader::onXmlDownloaded()
                 dm = 6;
         }
 
-        // Run parser
+        // Run parser in Python's thread, the module is only used there
         /* API definition:
          * def Danmaku2ASS(input_files,
          *                 input_format,
@@ -128,27 +139,58 @@ void DanmakuLoader::onXmlDownloaded()
          *                 is_reduce_comments=False,
          *                 progress_callback=None)
          */
-        PyObject *result = PyObject_CallFunction(danmaku2assFunc, "sssiiisdddd",
-                                                 reply->readAll().constData(),
-                                                 "autodetect",
-                                                 output_file.constData(),
-                                                 width,
-                                                 height,
-                                                 0,
-                                                 font.constData(),
-                                                 (double) fs,
-                                                 Settings::danmakuAlpha,
-                                                 (double) dm,
-                                                 (double) Settings::durationStill
-                                                 );
-        if (result) // success
-        {
-            Py_DecRef(result);
-            emit finished(output_file);
-        }
-        else
-            printPythonException();
+        QByteArray data = reply->readAll();
+        int stage_width = width, stage_height = height, gen = generation;
+        double alpha = Settings::danmakuAlpha, ds = Settings::durationStill;
+        python_thread->post([=]() {
+            if (danmaku2assFunc == nullptr)
+            {
+                if ((module = PyImport_ImportModule(DANMAKU2ASS)) == nullptr)
+                {
+                    printPythonException();
+                    exit(EXIT_FAILURE);
+                }
+                if ((danmaku2assFunc = PyObject_GetAttrString(module, "Danmaku2ASS")) == nullptr)
+                {
+                    printPythonException();
+                    exit(EXIT_FAILURE);
+                }
+            }
+            PyObject *result = PyObject_CallFunction(danmaku2assFunc, "sssiiisdddd",
+                                                     data.constData(),
+                                                     "autodetect",
+                                                     output_file.constData(),
+                                                     stage_width,
+                                                     stage_height,
+                                                     0,
+                                                     font.constData(),
+                                                     (double) fs,
+                                                     alpha,
+                                                     (double) dm,
+                                                     ds
+                                                     );
+            if (result) // success, the signal is queued to the main thread
+            {
+                Py_DecRef(result);
+                emit converted(gen, QString::fromUtf8(output_file));
+            }
+            else
+                printPythonException();
+        });
     }
     reply->deleteLater();
     reply = nullptr;
 }
+
+void DanmakuLoader::onConverted(int generation, const QString &assFile)
+{
+    if (generation != this->generation) // another video is opened
+    {
+        QFile::remove(assFile);
+        return;
+    }
+    if (!this->assFile.isEmpty() && this->assFile != assFile)
+        QFile::remove(this->assFile);
+    this->assFile = assFile;
+    emit finished(assFile);
+}
@@ -10,20 +10,26 @@ class DanmakuLoader : public QObject
     Q_OBJECT
 public:
     explicit DanmakuLoader(QObject *parent = 0);
+    ~DanmakuLoader();
 
 public slots:
     void load(const QString &srcFile, int width, int height);
+    void cancel(void);
 
 signals:
     void finished(const QString &assFile);
+    void converted(int generation, const QString &assFile);    // emitted in Python's thread
 
 private slots:
     void reload(void);
     void onXmlDownloaded(void);
+    void onConverted(int generation, const QString &assFile);
 
 private:
     QNetworkReply *reply;
     QString xmlFile;
+    QString assFile;        // output of the current load
+    int generation;         // increased on each load, results of previous loads are dropped
     PyObject *module;
     PyObject *danmaku2assFunc;
     int width;
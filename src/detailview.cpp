@@ -23,7 +23,7 @@ DetailView::~DetailView()
 }
 
 
-void DetailView::loadDetail(const QVariantHash &data)
+void DetailView::loadDetail(const PyDictView &data)
 {
     static QString nameFmt = "<span style=\" font-size:16pt; font-weight:600;\">%1</span> (rating: %2)";
 
@@ -100,7 +100,10 @@ void DetailView::onPlay()
         return;
     QString url = urls[current_row];
     if (url.startsWith("python:"))
+    {
+        PyGILLocker locker;
         PyRun_SimpleString(url.toUtf8().mid(7).constData());
+    }
     else
         parseUrl(url, false);
 }
@@ -113,7 +116,10 @@ void DetailView::onDownload()
         return;
     QString url = urls[current_row];
     if (url.startsWith("python:"))
+    {
+        PyGILLocker locker;
         PyRun_SimpleString(url.toUtf8().mid(7).constData());
+    }
     else
         parseUrl(url, true);
 }
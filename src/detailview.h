@@ -7,6 +7,7 @@ namespace Ui {
 class DetailView;
 }
 class QNetworkReply;
+class PyDictView;
 
 class DetailView : public QWidget
 {
@@ -15,7 +16,7 @@ class DetailView : public QWidget
 public:
     explicit DetailView(QWidget *parent = 0);
     ~DetailView();
-    void loadDetail(const QVariantHash &data);
+    void loadDetail(const PyDictView &data);
 
 private:
     Ui::DetailView *ui;
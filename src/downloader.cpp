@@ -1,23 +1,33 @@
 #include "downloader.h"
 #include <QGridLayout>
+#include <QLabel>
+#include <QNetworkReply>
+#include <QTimer>
 #include <QPushButton>
 #include <QTreeWidget>
-#include <QSpacerItem>
 #include <QMessageBox>
 #include <QUrl>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QPointer>
 #include "httpget.h"
+#include "postprocessor.h"
+#include "ratelimiter.h"
 #include "settings_network.h"
 #include "streamget.h"
+#include "streamserver.h"
 #include "videocombiner.h"
 #include <iostream>
 
+#define ADAPT_INTERVAL  5000    // ms
+#define HOLD_TICKS      6
+
 class DownloaderGroup : public QTreeWidgetItem {
 public:
     int finished;
     QDir dir;
+    QPointer<VideoCombiner> combiner;
     DownloaderGroup(QTreeWidget *tree, const QStringList &labels) : QTreeWidgetItem(tree, labels) {}
 };
 
@@ -28,6 +38,13 @@ Downloader::Downloader(QWidget *parent) :
 {
     std::cout << "Initialize downloader..." << std::endl;
     n_downloading = 0;
+    task_limit = qMin(2, Settings::maxTasks);
+    n_errors = prev_errors = 0;
+    hold_ticks = 0;
+    prev_rate = 0;
+    raised = false;
+    postProcessor = new PostProcessor(this);
+    streamServer = nullptr;
     QStringList labels;
     labels << tr("File name") << tr("State");
     treeWidget = new QTreeWidget;
@@ -38,10 +55,11 @@ Downloader::Downloader(QWidget *parent) :
     QPushButton *playButton = new QPushButton(tr("Play"));
     QPushButton *delButton = new QPushButton(tr("Delete"));
     QPushButton *pauseButton = new QPushButton(tr("Pause"));
-    QSpacerItem *spacer = new QSpacerItem(40, 20, QSizePolicy::Expanding);
+    tasksLabel = new QLabel;
 
     QGridLayout *layout = new QGridLayout(this);
-    layout->addItem(spacer, 0, 0, 1, 1);
+    layout->addWidget(tasksLabel, 0, 0, 1, 1);
+    layout->setColumnStretch(0, 1);
     layout->addWidget(playButton, 0, 1, 1, 1);
     layout->addWidget(delButton, 0, 2, 1, 1);
     layout->addWidget(pauseButton, 0, 3, 1, 1);
@@ -53,14 +71,19 @@ Downloader::Downloader(QWidget *parent) :
     connect(delButton, SIGNAL(clicked()), this, SLOT(onDelButton()));
     connect(pauseButton, SIGNAL(clicked()), this, SLOT(onPauseButton()));
 
+    adaptTimer = new QTimer(this);
+    adaptTimer->setInterval(ADAPT_INTERVAL);
+    connect(adaptTimer, &QTimer::timeout, this, &Downloader::adaptTaskLimit);
+    adaptTimer->start();
+
     downloader = this;
 }
 
 
 void Downloader::addTask(const QByteArray &url, const QString &filename, bool in_group, const QByteArray &danmaku)
 {
-    //rename if the same file is exist
-    if (QFile::exists(filename))
+    //rename if the same file is exist, unfinished downloads are resumed
+    if (QFile::exists(filename) && !QFile::exists(filename + ".pieces"))
     {
         if (QMessageBox::question(this,
                                   "Download again?",
@@ -71,11 +94,26 @@ void Downloader::addTask(const QByteArray &url, const QString &filename, bool in
     }
 
     DownloaderItem *item;
+    QString host = QUrl(QString::fromUtf8(url.simplified())).host();
     if (filename.endsWith(".m3u") || filename.endsWith(".m3u8")) // stream
         item = new StreamGet(QString::fromUtf8(url.simplified()), filename.section('.', 0, -2) + ".mp4", this);
     else
-        item = new HttpGet(QString::fromUtf8(url.simplified()), filename, this);
+    {
+        HttpGet *task = new HttpGet(QString::fromUtf8(url.simplified()), filename, this);
+        connect(task, &HttpGet::responded, this, [=](int msecs) {
+            int prev = hostResponse.value(host);
+            hostResponse[host] = prev ? (prev * 3 + msecs) / 4 : msecs;
+            if (!hostBestResponse.contains(host) || msecs < hostBestResponse[host])
+                hostBestResponse[host] = msecs;
+        });
+        item = task;
+    }
+    item2host[item] = host;
     connect(item, &DownloaderItem::finished, this, &Downloader::onFinished);
+    connect(item, &DownloaderItem::paused, this, [=](int reason) {
+        if (reason != QNetworkReply::OperationCanceledError)
+            n_errors++;
+    });
 
     // Add item to tree
     if (in_group)
@@ -109,12 +147,86 @@ void Downloader::addTask(const QByteArray &url, const QString &filename, bool in
     }
 
     //Start downloading
-    if (n_downloading < Settings::maxTasks) {
-        item->start();
-        n_downloading++;
+    waitings << item;
+    startWaitings();
+}
+
+int Downloader::taskLimit()
+{
+    return Settings::adaptiveTasks ? qMin(task_limit, Settings::maxTasks) : Settings::maxTasks;
+}
+
+// Don't put too many tasks on one host
+bool Downloader::canStart(const QString &host)
+{
+    int running = hostTasks.value(host);
+    if (running >= Settings::maxHostTasks)
+        return false;
+    // the host responds much slower than usual, it may be overloaded
+    if (Settings::adaptiveTasks && running > 0 && hostResponse.value(host) > hostBestResponse.value(host) * 2 + 500)
+        return false;
+    return true;
+}
+
+void Downloader::countTask(DownloaderItem *item, int delta)
+{
+    n_downloading += delta;
+    hostTasks[item2host.value(item)] += delta;
+    tasksLabel->setText(tr("Downloading: %1 / %2").arg(n_downloading).arg(taskLimit()));
+}
+
+void Downloader::startWaitings()
+{
+    int i = 0;
+    while (i < waitings.size() && n_downloading < taskLimit())
+    {
+        DownloaderItem *item = waitings[i];
+        if (canStart(item2host.value(item)))
+        {
+            waitings.removeAt(i);
+            item->start();
+            countTask(item, 1);
+        }
+        else
+            i++;
     }
-    else
-        waitings << item;
+}
+
+/* Adjust the task limit by the aggregate throughput:
+ * try one more task while the throughput keeps growing, take it back if the throughput does not grow,
+ * and halve the limit when errors happen.
+ */
+void Downloader::adaptTaskLimit()
+{
+    qint64 rate = rate_limiter->currentRate();
+    if (Settings::adaptiveTasks)
+    {
+        if (n_errors > prev_errors)
+        {
+            task_limit = qMax(1, task_limit / 2);
+            raised = false;
+            hold_ticks = HOLD_TICKS;
+        }
+        else if (raised && rate < prev_rate * 11 / 10) // flattened
+        {
+            task_limit = qMax(1, task_limit - 1);
+            raised = false;
+            hold_ticks = HOLD_TICKS;
+        }
+        else if (hold_ticks > 0)
+            hold_ticks--;
+        else if (n_downloading >= taskLimit() && !waitings.isEmpty() && task_limit < Settings::maxTasks)
+        {
+            task_limit++;
+            raised = true;
+        }
+        else
+            raised = false;
+    }
+    prev_rate = rate;
+    prev_errors = n_errors;
+    startWaitings();
+    tasksLabel->setText(tr("Downloading: %1 / %2").arg(n_downloading).arg(taskLimit()));
 }
 
 void Downloader::onFinished(QTreeWidgetItem *item, bool error)
@@ -125,14 +237,27 @@ void Downloader::onFinished(QTreeWidgetItem *item, bool error)
         group->finished++;
         group->setText(1, QString().sprintf("%d / %d", group->finished, group->childCount()));
         if (Settings::autoCombine && group->finished == group->childCount())
-            new VideoCombiner(this, group->dir);
-    }
-    n_downloading--;
-    while (n_downloading < Settings::maxTasks && !waitings.isEmpty())
-    {
-        waitings.takeFirst()->start();
-        n_downloading++;
+        {
+            VideoCombiner *combiner = new VideoCombiner(this, group->dir);
+            group->combiner = combiner;
+            group->setText(1, tr("Combining: queued"));
+            connect(combiner, &VideoCombiner::progressChanged, this, [=](int percentage) {
+                if (percentage < 0) // duration is unknown when transcoding
+                    group->setText(1, tr("Combining"));
+                else
+                    group->setText(1, tr("Combining: %1%").arg(percentage));
+            });
+            connect(combiner, &VideoCombiner::finished, this, [=](int status) {
+                group->setText(1, status ? tr("Combining failed") :
+                                           QString().sprintf("%d / %d", group->finished, group->childCount()));
+            });
+            postProcessor->add(combiner);
+        }
     }
+    if (error)
+        n_errors++;
+    countTask(static_cast<DownloaderItem*>(item), -1);
+    startWaitings();
 }
 
 void Downloader::onPlayButton()
@@ -146,13 +271,13 @@ void Downloader::onPlayButton()
         QTreeWidgetItem *child = item->child(0);
         QDir dir(item->text(0));
         QString name = child->text(0);
-        emit newPlay(name, dir.filePath(name));
+        emit newPlay(name, playPath(child, dir.filePath(name)));
         int i = 1;
         child = item->child(1);
         while (child)
         {
             name = child->text(0);
-            emit newFile(name, dir.filePath(name));
+            emit newFile(name, playPath(child, dir.filePath(name)));
             i++;
             child = item->child(i);
         }
@@ -163,20 +288,65 @@ void Downloader::onPlayButton()
     if (item->parent())
     {
         QDir dir(item->parent()->text(0));
-        emit newPlay(name, dir.filePath(name));
+        emit newPlay(name, playPath(item, dir.filePath(name)));
     }
     else
-        emit newPlay(QFileInfo(name).fileName(), name);
+        emit newPlay(QFileInfo(name).fileName(), playPath(item, name));
     window()->close();
 }
 
+// Unfinished files are played through the stream server while downloading
+QString Downloader::playPath(QTreeWidgetItem *item, const QString &file)
+{
+    HttpGet *task = dynamic_cast<HttpGet*>(static_cast<DownloaderItem*>(item));
+    if (task == nullptr || task->isComplete())
+        return file;
+
+    // download it at once
+    if (task->text(1) == "Wait")
+    {
+        waitings.removeOne(task);
+        task->start();
+        countTask(task, 1);
+    }
+    else if (task->text(1).startsWith("Pause"))
+        task->pause();
+
+    if (streamServer == nullptr)
+    {
+        streamServer = new StreamServer(this);
+        // the player wants data from offset, download it first
+        connect(streamServer, &StreamServer::rangeWanted, [](HttpGet *task, qint64 offset) {
+            task->setPriorityOffset(offset);
+            if (task->text(1).startsWith("Pause"))
+                task->pause();
+        });
+    }
+    return streamServer->addTask(task);
+}
+
 void Downloader::onDelButton()
 {
     QTreeWidgetItem *i = treeWidget->currentItem();
     if (!i)
         return;
     if (i->childCount()) //group
+    {
+        // cancel combining
+        DownloaderGroup *group = static_cast<DownloaderGroup*>(i);
+        if (group->combiner && QMessageBox::Yes == QMessageBox::question(this,
+                                                                       "Confirm",
+                                                                       tr("Video clips are being combined. Cancel it?"),
+                                                                       QMessageBox::Yes,
+                                                                       QMessageBox::No))
+        {
+            group->combiner->disconnect(this);
+            postProcessor->cancel(group->combiner);
+            group->combiner = nullptr;
+            group->setText(1, QString().sprintf("%d / %d", group->finished, group->childCount()));
+        }
         return;
+    }
 
     DownloaderItem *item = static_cast<DownloaderItem*>(i);
     QString state = item->text(1);
@@ -192,8 +362,12 @@ void Downloader::onDelButton()
         if (state == "Wait")
             waitings.removeOne(item);
         else
-            n_downloading--;
+        {
+            countTask(item, -1);
+            startWaitings();
+        }
     }
+    item2host.remove(item);
     item->deleteLater();
 }
 
@@ -202,13 +376,20 @@ void Downloader::onPauseButton()
     QTreeWidgetItem *item = treeWidget->currentItem();
     if (!item)
         return;
-    if (item->childCount() || item->text(1) == "Finished") //group or finished
+    if (item->childCount()) //group, combine it first
+    {
+        DownloaderGroup *group = static_cast<DownloaderGroup*>(item);
+        if (group->combiner && postProcessor->isQueued(group->combiner))
+            postProcessor->setPriority(group->combiner, PostProcessor::HIGH_PRIORITY);
+        return;
+    }
+    if (item->text(1) == "Finished")
         return;
     DownloaderItem *i = static_cast<DownloaderItem*>(item);
     if (i->text(1) == "Wait")
     {
         waitings.removeOne(i);
-        n_downloading++;
+        countTask(i, 1);
     }
     i->pause();
 }
@@ -1,12 +1,17 @@
 #ifndef DOWNLOADER_H
 #define DOWNLOADER_H
 
+#include <QHash>
 #include <QWidget>
 
+class QLabel;
+class QTimer;
 class QTreeWidget;
 class QTreeWidgetItem;
 class DownloaderGroup;
 class DownloaderItem;
+class PostProcessor;
+class StreamServer;
 
 class Downloader : public QWidget
 {
@@ -27,13 +32,33 @@ private:
     QTreeWidget *treeWidget;
     QHash<QString, DownloaderGroup*> dir2group;
     QList<DownloaderItem*> waitings;
+    PostProcessor *postProcessor;
+    StreamServer *streamServer;
+    QLabel *tasksLabel;
+    QTimer *adaptTimer;
+    QHash<DownloaderItem*, QString> item2host;
+    QHash<QString, int> hostTasks;          // running tasks of each host
+    QHash<QString, int> hostResponse;       // smoothed response time of each host in ms
+    QHash<QString, int> hostBestResponse;
     int n_downloading;
+    int task_limit;         // adjusted by throughput if Settings::adaptiveTasks is set
+    int n_errors;
+    int prev_errors;
+    int hold_ticks;         // don't try more tasks for a while after it did not help
+    qint64 prev_rate;
+    bool raised;
+    QString playPath(QTreeWidgetItem *item, const QString &file);
+    int taskLimit(void);
+    bool canStart(const QString &host);
+    void countTask(DownloaderItem *item, int delta);
+    void startWaitings(void);
 
 private slots:
     void onFinished(QTreeWidgetItem *item, bool error);
     void onPauseButton(void);
     void onPlayButton(void);
     void onDelButton(void);
+    void adaptTaskLimit(void);
 };
 extern Downloader *downloader;
 
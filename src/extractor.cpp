@@ -2,15 +2,18 @@
 #include "platform/paths.h"
 #include <QDir>
 
-Extractor **extractors = nullptr;
-int n_extractors = 0;
-QStringList Extractor::supportedHosts;
+QList<Extractor*> extractors;
+QSet<QString> Extractor::supportedHosts;
+QHash<QString, Extractor*> Extractor::hostExtractors;
+
+// All url patterns in one alternation "(?<e0>...)|(?<e1>...)|...", so most urls are rejected by one match
+static QRegularExpression combinedPattern;
+static QList<QPair<int, int> > combinedGroups;  // (capture group, index of extractor)
+static QList<int> separateExtractors;           // patterns with back references or named groups are matched alone
 
 void initExtractors()
 {
-    static Extractor *array[128];
-    extractors = array;
-
+    PyGILLocker locker;
     QDir pluginsDir = QDir(getUserPath() + "/plugins");
     QStringList list = pluginsDir.entryList(QDir::Files, QDir::Name);
 
@@ -22,10 +25,7 @@ void initExtractors()
             bool ok = false;
             Extractor *extractor = new Extractor(filename.section('.', 0, 0), &ok);
             if (ok)
-            {
-                array[n_extractors] = extractor;
-                n_extractors++;
-            }
+                extractors << extractor;
             else
             {
                 delete extractor;
@@ -33,6 +33,7 @@ void initExtractors()
             }
         }
     }
+    Extractor::updateMatcher();
 }
 
 
@@ -55,9 +56,24 @@ Extractor::Extractor(const QString &name, bool *ok)
         return;
     }
     for (int i = 0; i < PyTuple_Size(hosts); i++)
-        supportedHosts << PyString_AsQString(PyTuple_GetItem(hosts, i));
+    {
+        QString host = PyString_AsQString(PyTuple_GetItem(hosts, i));
+        supportedHosts << host;
+        hostExtractors[host] = this;
+    }
     Py_DecRef(hosts);
 
+    // optional, resource types which must not be blocked in the browser, e.g. ("media",)
+    PyObject *resources = PyObject_GetAttrString(module, "allowed_resources");
+    if (resources)
+    {
+        for (int i = 0; i < PyTuple_Size(resources); i++)
+            allowedResources << PyString_AsQString(PyTuple_GetItem(resources, i));
+        Py_DecRef(resources);
+    }
+    else
+        PyErr_Clear();
+
     parseFunc = PyObject_GetAttrString(module, "parse");
     if (parseFunc == nullptr)
     {
@@ -75,12 +91,16 @@ Extractor::Extractor(const QString &name, bool *ok)
     }
     urlPattern = QRegularExpression(PyString_AsQString(url_pattern),
                                     QRegularExpression::DotMatchesEverythingOption);
+    urlPattern.optimize();
     Py_DecRef(url_pattern);
     *ok = true;
 }
 
 Extractor::~Extractor()
 {
+    PyGILLocker locker;
+    for (auto i = hostExtractors.begin(); i != hostExtractors.end();)
+        i = (i.value() == this) ? hostExtractors.erase(i) : i + 1;
     Py_DecRef(module);
     Py_DecRef(parseFunc);
 }
@@ -92,23 +112,90 @@ bool Extractor::match(const QString &url)
     return match.hasMatch();
 }
 
+void Extractor::updateMatcher()
+{
+    static QRegularExpression unsafe("\\\\[1-9gk]|\\(\\?P?<[A-Za-z_]|\\(\\?P?'");
+    QStringList parts;
+    separateExtractors.clear();
+    for (int i = 0; i < extractors.size(); i++)
+    {
+        QString pattern = extractors[i]->urlPattern.pattern();
+        if (unsafe.match(pattern).hasMatch() || !extractors[i]->urlPattern.isValid())
+            separateExtractors << i;
+        else
+            parts << QString("(?<e%1>%2)").arg(QString::number(i), pattern);
+    }
+    combinedGroups.clear();
+    if (parts.isEmpty())
+        return;
+    combinedPattern = QRegularExpression(parts.join('|'), QRegularExpression::DotMatchesEverythingOption);
+    if (!combinedPattern.isValid())
+    {
+        qDebug("[plugin] Fails to combine url patterns");
+        separateExtractors.clear();
+        for (int i = 0; i < extractors.size(); i++)
+            separateExtractors << i;
+        return;
+    }
+    combinedPattern.optimize();
+    QStringList names = combinedPattern.namedCaptureGroups();
+    for (int i = 1; i < names.size(); i++)
+    {
+        if (names[i].startsWith('e'))
+            combinedGroups << qMakePair(i, names[i].mid(1).toInt());
+    }
+}
+
 Extractor *Extractor::getMatchedExtractor(const QString &url)
 {
-    for (int i = 0; i < n_extractors; i++)
+    int found = -1;
+    if (!combinedGroups.isEmpty())
+    {
+        QRegularExpressionMatch match = combinedPattern.match(url);
+        if (match.hasMatch())
+        {
+            for (int i = 0; i < combinedGroups.size(); i++)
+            {
+                if (match.capturedStart(combinedGroups[i].first) != -1)
+                {
+                    found = combinedGroups[i].second;
+                    break;
+                }
+            }
+        }
+    }
+    foreach (int i, separateExtractors)
+    {
+        if (found != -1 && i > found)
+            break;
+        if (extractors[i]->match(url))
+        {
+            found = i;
+            break;
+        }
+    }
+    if (found == -1)
+        return nullptr;
+
+    // the alternation takes the leftmost match, but an earlier extractor has priority
+    for (int i = 0; i < found; i++)
     {
         if (extractors[i]->match(url))
             return extractors[i];
     }
-    return nullptr;
+    return extractors[found];
 }
 
 
-QString Extractor::parse(const QByteArray &data)
+QString Extractor::parse(const QString &data)
 {
-    PyObject *result = PyObject_CallFunction(parseFunc, "s", data.constData());
+    PyGILLocker locker;
+    PyObject *content = PyString_FromQString(data);
+    PyObject *result = content ? PyObject_CallFunctionObjArgs(parseFunc, content, nullptr) : nullptr;
+    Py_DecRef(content);
     if (result == nullptr)
         return QString("Python Exception:\n%1\n\nResponse Content:\n%2").arg(
-                    fetchPythonException(), QString::fromUtf8(data));
+                    fetchPythonException(), data);
     else
     {
         Py_DecRef(result);
@@ -116,6 +203,11 @@ QString Extractor::parse(const QByteArray &data)
     }
 }
 
+Extractor *Extractor::getExtractorByHost(const QString &host)
+{
+    return hostExtractors.value(host);
+}
+
 bool Extractor::isSupported(const QString &host)
 {
     return supportedHosts.contains(host);
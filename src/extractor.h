@@ -3,29 +3,37 @@
 
 #include "python_wrapper.h"
 #include <QByteArray>
+#include <QHash>
+#include <QList>
 #include <QRegularExpression>
+#include <QSet>
 
 class Extractor
 {
 public:
     Extractor(const QString &name, bool *ok);
     ~Extractor();
-    QString parse(const QByteArray &data); // Parse the catched data, return error string
+    QString parse(const QString &data);    // Parse the catched data, return error string
     bool match(const QString &url);        // Check if the catched data with url can be processed
+    inline const QStringList &getAllowedResources() { return allowedResources; }  // resources not to be blocked
 
     static bool isSupported(const QString &host);  // Check if the website with host can be extracted
     static Extractor *getMatchedExtractor(const QString &url);
+    static Extractor *getExtractorByHost(const QString &host);
+    static void updateMatcher(void);        // call it after the registry is changed
+    static inline const QSet<QString> &getSupportedHosts() { return supportedHosts; }
 
 private:
     PyObject *module;
     PyObject *parseFunc;
     QRegularExpression urlPattern;
-    static QStringList supportedHosts;
+    QStringList allowedResources;
+    static QSet<QString> supportedHosts;
+    static QHash<QString, Extractor*> hostExtractors;
 };
 
 void initExtractors(void);
 
-extern Extractor **extractors;
-extern int n_extractors;
+extern QList<Extractor*> extractors;
 
 #endif // EXTRACTOR_H
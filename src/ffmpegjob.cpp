@@ -0,0 +1,95 @@
+#include "ffmpegjob.h"
+#include "platform/paths.h"
+#include <QRegularExpression>
+
+FFmpegJob::FFmpegJob(QObject *parent) :
+    QProcess(parent)
+{
+    duration_us = out_time_us = total_size = 0;
+    speed_x = 0;
+    duration_given = false;
+    connect(this, &FFmpegJob::readyReadStandardOutput, this, &FFmpegJob::readProgress);
+    connect(this, &FFmpegJob::readyReadStandardError, this, &FFmpegJob::readError);
+}
+
+
+void FFmpegJob::start(const QStringList &args)
+{
+    out_time_us = total_size = 0;
+    speed_x = 0;
+    if (!duration_given)
+        duration_us = 0;
+    stderrOutput.clear();
+    // progress is written to stdout, "-nostats" keeps stderr for errors only
+    QProcess::start(ffmpegFilePath(), QStringList() << "-nostats" << "-progress" << "pipe:1" << args, QProcess::ReadOnly);
+}
+
+
+void FFmpegJob::setDuration(qint64 duration_us)
+{
+    this->duration_us = duration_us;
+    duration_given = duration_us > 0;
+}
+
+
+int FFmpegJob::percentage()
+{
+    if (duration_us <= 0)
+        return -1;
+    return qBound((qint64) 0, out_time_us * 100 / duration_us, (qint64) 100);
+}
+
+
+// Each report is a block of key=value lines ended by "progress=continue" or "progress=end"
+void FFmpegJob::readProgress()
+{
+    setReadChannel(QProcess::StandardOutput);
+    while (canReadLine())
+    {
+        QByteArray line = readLine().trimmed();
+        int i = line.indexOf('=');
+        if (i == -1)
+            continue;
+        QByteArray key = line.left(i);
+        QByteArray value = line.mid(i + 1);
+
+        // old versions of ffmpeg write microseconds as "out_time_ms"
+        if (key == "out_time_us" || key == "out_time_ms")
+        {
+            bool ok;
+            qint64 t = value.toLongLong(&ok);
+            if (ok)
+                out_time_us = t;
+        }
+        else if (key == "total_size")
+        {
+            bool ok;
+            qint64 size = value.toLongLong(&ok);
+            if (ok)
+                total_size = size;
+        }
+        else if (key == "speed")
+            speed_x = value.left(value.indexOf('x')).toDouble(); // "N/A" is read as 0
+        else if (key == "progress")
+            emit progressChanged(percentage());
+    }
+}
+
+
+void FFmpegJob::readError()
+{
+    int from = stderrOutput.size();
+    stderrOutput += readAllStandardError();
+
+    // read the duration of input
+    if (duration_us == 0)
+    {
+        static QRegularExpression re("Duration: (\\d+):(\\d\\d):(\\d\\d)\\.(\\d\\d)");
+        QRegularExpressionMatch match = re.match(QString::fromUtf8(stderrOutput.mid(qMax(0, from - 32))));
+        if (match.hasMatch())
+        {
+            duration_us = ((match.captured(1).toLongLong() * 60 + match.captured(2).toLongLong()) * 60 +
+                           match.captured(3).toLongLong()) * 1000000 + match.captured(4).toLongLong() * 10000;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FFMPEGJOB_H
+#define FFMPEGJOB_H
+
+#include <QProcess>
+
+/* Run ffmpeg with "-progress pipe:1" and parse its key=value reports as they arrive.
+ * The percentage is calculated from the duration given by setDuration(),
+ * or from the input's duration printed by ffmpeg. It is -1 if the duration is unknown.
+ */
+
+class FFmpegJob : public QProcess
+{
+    Q_OBJECT
+public:
+    explicit FFmpegJob(QObject *parent = nullptr);
+    void start(const QStringList &args);
+    void setDuration(qint64 duration_us);
+    int percentage(void);
+    inline qint64 outTime() { return out_time_us; }
+    inline double speed() { return speed_x; }
+    inline qint64 totalSize() { return total_size; }
+    inline QByteArray errorOutput() { return stderrOutput; }
+
+signals:
+    void progressChanged(int percentage);
+
+private:
+    qint64 duration_us;
+    qint64 out_time_us;
+    qint64 total_size;
+    double speed_x;
+    bool duration_given;
+    QByteArray stderrOutput;
+
+private slots:
+    void readProgress(void);
+    void readError(void);
+};
+
+#endif // FFMPEGJOB_H
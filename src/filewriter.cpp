@@ -0,0 +1,185 @@
+#include "filewriter.h"
+#include <QMutexLocker>
+#include <QTimer>
+#include <string.h>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+#define BUFFER_ALIGNMENT    4096
+#define IDLE_FLUSH_TIME     200     // ms
+
+FileWriter::FileWriter(const QString &filename, QObject *parent) :
+    QThread(parent), file(filename)
+{
+    current.data = nullptr;
+    current.offset = current.size = 0;
+    preallocate_size = 0;
+    quit = false;
+    was_full = false;
+    failed = false;
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(IDLE_FLUSH_TIME);
+    connect(idleTimer, &QTimer::timeout, this, &FileWriter::flush);
+}
+
+FileWriter::~FileWriter()
+{
+    close();
+    if (current.data)
+        freeBuffers << current.data;
+    foreach (char *buffer, freeBuffers)
+        qFreeAligned(buffer);
+}
+
+
+bool FileWriter::open(bool truncate)
+{
+    if (!file.open(truncate ? (QFile::WriteOnly | QFile::Truncate) : QFile::ReadWrite))
+        return false;
+    quit = false;
+    failed = false;
+    start(QThread::LowPriority);
+    return true;
+}
+
+
+char *FileWriter::allocBuffer()
+{
+    QMutexLocker locker(&mutex);
+    if (!freeBuffers.isEmpty())
+        return freeBuffers.takeLast();
+    return (char*) qMallocAligned(BUFFER_SIZE, BUFFER_ALIGNMENT);
+}
+
+
+void FileWriter::write(qint64 offset, const QByteArray &data)
+{
+    const char *src = data.constData();
+    qint64 size = data.size();
+    // not contiguous
+    if (current.size && current.offset + current.size != offset)
+        flush();
+
+    while (size > 0)
+    {
+        if (current.data == nullptr)
+            current.data = allocBuffer();
+        if (current.size == 0)
+            current.offset = offset;
+        // end the buffer at a multiple of BUFFER_SIZE in file
+        qint64 capacity = BUFFER_SIZE - (current.offset % BUFFER_SIZE) - current.size;
+        qint64 n = qMin(size, capacity);
+        memcpy(current.data + current.size, src, n);
+        current.size += n;
+        src += n;
+        offset += n;
+        size -= n;
+        if (n == capacity)
+            flush();
+    }
+    idleTimer->start();
+}
+
+
+// Queue the current buffer
+void FileWriter::flush()
+{
+    idleTimer->stop();
+    if (current.size == 0)
+        return;
+    QMutexLocker locker(&mutex);
+    queue << current;
+    current.data = nullptr;
+    current.size = 0;
+    cond.wakeOne();
+}
+
+
+void FileWriter::preallocate(qint64 size)
+{
+    QMutexLocker locker(&mutex);
+    preallocate_size = size;
+    cond.wakeOne();
+}
+
+
+bool FileWriter::isFull()
+{
+    QMutexLocker locker(&mutex);
+    if (queue.size() >= MAX_BUFFERS)
+        was_full = true;
+    return was_full;
+}
+
+
+bool FileWriter::hasFailed()
+{
+    QMutexLocker locker(&mutex);
+    return failed;
+}
+
+
+void FileWriter::close()
+{
+    if (!file.isOpen())
+        return;
+    flush();
+    mutex.lock();
+    quit = true;
+    cond.wakeOne();
+    mutex.unlock();
+    wait();
+    file.close();
+}
+
+
+void FileWriter::run()
+{
+    forever
+    {
+        mutex.lock();
+        while (queue.isEmpty() && preallocate_size == 0 && !quit)
+            cond.wait(&mutex);
+        if (queue.isEmpty() && preallocate_size == 0) // quit
+        {
+            mutex.unlock();
+            return;
+        }
+        qint64 allocSize = preallocate_size;
+        preallocate_size = 0;
+        Buffer buffer = {nullptr, 0, 0};
+        if (!queue.isEmpty())
+            buffer = queue.first();
+        mutex.unlock();
+
+        // reserve disk space, so that pieces written in any order don't fragment the file
+        if (allocSize > 0)
+        {
+#ifdef Q_OS_LINUX
+            posix_fallocate(file.handle(), 0, allocSize);
+#endif
+        }
+
+        if (buffer.data)
+        {
+            bool ok = file.seek(buffer.offset) && file.write(buffer.data, buffer.size) == buffer.size && file.flush();
+            QString errorString = ok ? QString() : file.errorString();
+            mutex.lock();
+            failed = failed || !ok;
+            queue.removeFirst();
+            freeBuffers << buffer.data;
+            bool is_drained = was_full && queue.size() < MAX_BUFFERS / 2;
+            if (is_drained)
+                was_full = false;
+            mutex.unlock();
+            if (ok)
+                emit dataWritten(buffer.offset, buffer.size);
+            else
+                emit writeFailed(buffer.offset, buffer.size, errorString);
+            if (is_drained)
+                emit drained();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+class QTimer;
+
+/* Write a file on a dedicated thread.
+ * Contiguous writes are coalesced into fixed-size aligned buffers, which end at multiples of
+ * BUFFER_SIZE in the file. At most MAX_BUFFERS buffers are queued; when isFull() returns true
+ * the caller should stop reading from network until drained() is emitted, so memory stays flat.
+ * A partly filled buffer is written when no data comes for a short while.
+ */
+
+class FileWriter : public QThread
+{
+    Q_OBJECT
+public:
+    enum {BUFFER_SIZE = 1024 * 1024, MAX_BUFFERS = 8};
+
+    FileWriter(const QString &filename, QObject *parent = nullptr);
+    ~FileWriter();
+    bool open(bool truncate);
+    void write(qint64 offset, const QByteArray &data);
+    void flush(void);
+    void preallocate(qint64 size);
+    void close(void);   // blocks until all data is written
+    bool isFull(void);
+    bool hasFailed(void);   // a write has failed since open()
+
+signals:
+    void dataWritten(qint64 offset, qint64 size);
+    void writeFailed(qint64 offset, qint64 size, const QString &errorString);   // emitted instead of dataWritten()
+    void drained(void);
+
+protected:
+    void run(void);
+
+private:
+    struct Buffer
+    {
+        char *data;
+        qint64 offset;
+        qint64 size;
+    };
+    QFile file;
+    QTimer *idleTimer;
+    Buffer current;
+    QList<Buffer> queue;
+    QList<char*> freeBuffers;
+    QMutex mutex;
+    QWaitCondition cond;
+    qint64 preallocate_size;
+    bool quit;
+    bool was_full;
+    bool failed;
+    char *allocBuffer(void);
+};
+
+#endif // FILEWRITER_H
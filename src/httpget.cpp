@@ -1,126 +1,528 @@
 #include "httpget.h"
 #include "accessmanager.h"
+#include "filewriter.h"
+#include "ratelimiter.h"
+#include <QDataStream>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrentRun>
+
+#define PIECE_SIZE      (1024 * 1024)
+#define READ_AHEAD      (4 * PIECE_SIZE)    // don't switch the request if it will reach the wanted offset soon
+#define SAVE_INTERVAL   16                  // save the piece bitmap after every 16 pieces
+#define READ_BUFFER     (256 * 1024)        // data is left in socket when reading is limited
+#define WRITE_FAILED    -1                  // reason of paused() when the file cannot be written
 
 //start download task
 HttpGet::HttpGet(const QUrl &url, const QString &filename, QObject *parent) :
     DownloaderItem(filename, parent)
 {
-    //open file
-    last_finished = 0;
     prev_progress = 0;
     reply = 0;
+    total_size = -1;
+    finished_bytes = 0;
+    reply_start = reply_pos = run_written = 0;
+    reply_end = -1;
+    priority_offset = 0;
+    checksum_algorithm = QCryptographicHash::Md5;
+    run_hash = nullptr;
+    verifier = nullptr;
+    unsaved_pieces = 0;
+    verify_failures = 0;
     is_paused = true;
+    is_complete = false;
+    switching = false;
+    bad_response = false;
     name = filename;
-    file = new QFile(filename);
-    if (!file->open(QFile::WriteOnly))
+    //Set url
+    this->url = url;
+
+    connect(rate_limiter, &RateLimiter::refilled, this, &HttpGet::onReadyRead);
+
+    //open file, keep the downloaded pieces
+    loadPieces();
+    writer = new FileWriter(filename, this);
+    if (!writer->open(pieces.isEmpty()))
     {
         qDebug("Create file failed: %s", filename.toUtf8().constData());
         emit finished(this, true);
-        delete file;
-        file = nullptr;
+        delete writer;
+        writer = nullptr;
         deleteLater();
         return;
     }
-    //Set url
-    this->url = url;
+    connect(writer, &FileWriter::dataWritten, this, &HttpGet::onDataWritten);
+    connect(writer, &FileWriter::writeFailed, this, &HttpGet::onWriteFailed);
+    connect(writer, &FileWriter::drained, this, &HttpGet::onReadyRead);
 }
 
 //start a request
 void HttpGet::start()
 {
-    if (file == nullptr)
+    if (writer == nullptr || is_complete || verifier)
         return;
     is_paused = false;
+    emit progressChanged(prev_progress, true);
+    scheduleNext();
+}
+
+void HttpGet::request(qint64 from, qint64 to)
+{
     QNetworkRequest request(url);
-    if (last_finished)
-        request.setRawHeader("Range", "bytes=" + QByteArray::number(file->size()) + '-');
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    // also ask for a range from 0 to know whether the server supports it
+    request.setRawHeader("Range", "bytes=" + QByteArray::number(from) + '-' + (to > 0 ? QByteArray::number(to - 1) : QByteArray()));
     if (referer_table.contains(url.host()))
         request.setRawHeader("Referer", referer_table[url.host()]);
+    // get the whole new file instead of a range of it if the file is changed on server
+    if (!pieces.isEmpty() && !validator.isEmpty() && !validator.startsWith("W/"))
+        request.setRawHeader("If-Range", validator);
+    reply_start = reply_pos = run_written = from;
+    reply_end = to;
+    delete run_hash;
+    run_hash = nullptr;
+    request_time.start();
     reply = access_manager->get(request);
+    reply->setReadBufferSize(READ_BUFFER);
+    connect(reply, SIGNAL(metaDataChanged()), this, SLOT(onMetaDataChanged()));
     connect(reply, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
     connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
-    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(onProgressChanged(qint64,qint64)));
-    emit progressChanged(prev_progress, true);
+}
+
+// Request the next run of missing pieces
+void HttpGet::scheduleNext()
+{
+    if (pieces.isEmpty()) // size or range support is unknown, or sequential download
+    {
+        request(0, -1);
+        return;
+    }
+    int i = nextPiece();
+    if (i == -1)
+    {
+        // otherwise wait for the writer, see onDataWritten()
+        if (finished_bytes == total_size)
+            verify();
+        return;
+    }
+    int j = i;
+    while (j < pieces.size() && !pieces.testBit(j) && !received.testBit(j))
+        j++;
+    request((qint64) i * PIECE_SIZE, qMin((qint64) j * PIECE_SIZE, total_size));
+}
+
+// The first missing piece after the priority offset, or the first missing piece if all after it are finished
+int HttpGet::nextPiece()
+{
+    int start = qBound(0, (int) (priority_offset / PIECE_SIZE), pieces.size());
+    for (int i = start; i < pieces.size(); i++)
+    {
+        if (!pieces.testBit(i) && !received.testBit(i))
+            return i;
+    }
+    for (int i = 0; i < start; i++)
+    {
+        if (!pieces.testBit(i) && !received.testBit(i))
+            return i;
+    }
+    return -1;
+}
+
+void HttpGet::setPriorityOffset(qint64 offset)
+{
+    priority_offset = offset;
+    if (pieces.isEmpty() || reply == nullptr || switching)
+        return;
+    int i = offset / PIECE_SIZE;
+    if (i >= pieces.size() || pieces.testBit(i) || received.testBit(i))
+        return;
+    // the current request has got it or will get it soon
+    if (offset >= reply_start && (offset < reply_pos || offset - reply_pos < READ_AHEAD) &&
+            (reply_end < 0 || offset < reply_end))
+        return;
+    switching = true;
+    reply->abort();
+}
+
+// Read the size and whether "Range" is supported
+void HttpGet::onMetaDataChanged()
+{
+    emit responded(request_time.elapsed());
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray new_validator = reply->rawHeader("ETag");
+    if (new_validator.isEmpty())
+        new_validator = reply->rawHeader("Last-Modified");
+    if (status == 206)
+    {
+        // "bytes first-last/total", the data must start where it is asked
+        QByteArray range = reply->rawHeader("Content-Range");
+        qint64 first = range.mid(6, range.indexOf('-') - 6).toLongLong();
+        if (!range.startsWith("bytes ") || first != reply_start)
+        {
+            qDebug("Unexpected Content-Range: %s", range.constData());
+            bad_response = true;
+            reply->abort();
+            return;
+        }
+        qint64 total = range.mid(range.lastIndexOf('/') + 1).toLongLong();
+        if (total > 0 && total != total_size)
+        {
+            if (!pieces.isEmpty())
+                qDebug("File size is changed, download again: %s", name.toUtf8().constData());
+            resetPieces(total);
+        }
+        else if (!validator.isEmpty() && !new_validator.isEmpty() && new_validator != validator)
+        {
+            qDebug("File is changed on server, download again: %s", name.toUtf8().constData());
+            resetPieces(total);
+        }
+        validator = new_validator;
+        readChecksum(status);
+        if (reply->hasRawHeader("Content-MD5"))
+        {
+            run_checksum = QByteArray::fromBase64(reply->rawHeader("Content-MD5"));
+            run_hash = new QCryptographicHash(QCryptographicHash::Md5);
+        }
+    }
+    else if (status == 200) // download sequentially from the beginning
+    {
+        if (!pieces.isEmpty())
+        {
+            pieces.clear();
+            received.clear();
+            finished_bytes = 0;
+            QFile::remove(name + ".pieces");
+        }
+        bool ok;
+        qint64 total = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+        total_size = ok && total > 0 ? total : -1;
+        reply_start = reply_pos = run_written = 0;
+        reply_end = -1;
+        validator = new_validator;
+        readChecksum(status);
+    }
+}
+
+// Read the checksum of the whole file, "Digest: sha-256=<base64>,md5=<base64>" or "x-goog-hash: md5=<base64>"
+void HttpGet::readChecksum(int status)
+{
+    QList<QByteArray> items = reply->rawHeader("Digest").split(',') + reply->rawHeader("x-goog-hash").split(',');
+    foreach (QByteArray item, items)
+    {
+        int i = item.indexOf('=');
+        if (i == -1)
+            continue;
+        QByteArray key = item.left(i).trimmed().toLower();
+        QByteArray value = QByteArray::fromBase64(item.mid(i + 1).trimmed());
+        if (key == "sha-256")
+        {
+            checksum = value;
+            checksum_algorithm = QCryptographicHash::Sha256;
+            return;
+        }
+        else if (key == "md5" && (checksum.isEmpty() || checksum_algorithm == QCryptographicHash::Md5))
+        {
+            checksum = value;
+            checksum_algorithm = QCryptographicHash::Md5;
+        }
+    }
+    // "Content-MD5" of a full response is the checksum of the whole file
+    if (status == 200 && reply->hasRawHeader("Content-MD5"))
+    {
+        checksum = QByteArray::fromBase64(reply->rawHeader("Content-MD5"));
+        checksum_algorithm = QCryptographicHash::Md5;
+    }
 }
 
 void HttpGet::onFinished()
 {
     Q_ASSERT(reply);
-    file->write(reply->readAll());
-
-    //check redirect
+    // the rest data is small as the read buffer is limited
+    QByteArray data = reply->readAll();
+    rate_limiter->consume(this, data.size());
+    if (!bad_response)
+        writeData(data);
+    QNetworkReply::NetworkError reason = reply->error();
     int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-    if (status == 301 || status == 302) //redirect
+    QString errorString = reply->errorString();
+    reply->deleteLater();
+    reply = 0;
+    writer->flush();
+
+    // download the range again if it is broken
+    if (run_hash && reason == QNetworkReply::NoError && reply_pos == (reply_end < 0 ? total_size : reply_end) &&
+            run_hash->result() != run_checksum)
     {
-        reply->deleteLater();
-        file->seek(0);
-        last_finished = 0;
-        url = QString::fromUtf8(reply->rawHeader("Location"));
-        start();
+        qDebug("Checksum of range %lld-%lld mismatches: %s", reply_start, reply_pos, name.toUtf8().constData());
+        invalidate(reply_start, reply_pos);
     }
+    delete run_hash;
+    run_hash = nullptr;
 
-    else if (reply->error() != QNetworkReply::NoError) //has error or pause
+    if (switching) // go to the piece which player wants
     {
-        QNetworkReply::NetworkError reason = reply->error();
-        if (reason != QNetworkReply::OperationCanceledError)
-            qDebug("Http status code: %d\n%s\n", status, reply->errorString().toUtf8().constData());
-        if (reason == QNetworkReply::ContentOperationNotPermittedError)
+        switching = false;
+        scheduleNext();
+    }
+
+    else if (reason != QNetworkReply::NoError) //has error or pause
+    {
+        if (bad_response)
         {
-            // Remote server reject "Range" in http header
-            last_finished = 0;
-            file->seek(0);
+            bad_response = false;
+            reason = QNetworkReply::ProtocolFailure;
         }
-        else
-            last_finished = file->size();
-        reply->deleteLater();
-        reply = 0;
+        else if (reason != QNetworkReply::OperationCanceledError)
+            qDebug("Http status code: %d\n%s\n", status, errorString.toUtf8().constData());
+        savePieces();
+        rate_limiter->remove(this);
         is_paused = true;
         emit paused((int) reason);
     }
 
-    else  //finished
+    else if (pieces.isEmpty())  //sequential download finished
     {
-        reply->deleteLater();
-        reply = 0;
-        emit finished(this, false);
-        //close file
-        file->close();
-        delete file;
-        file = 0;
+        // the connection is closed early, start from the beginning when resumed
+        if (total_size > 0 && reply_pos != total_size)
+        {
+            qDebug("Data is incomplete: %lld / %lld", reply_pos, total_size);
+            rate_limiter->remove(this);
+            is_paused = true;
+            emit paused((int) QNetworkReply::UnknownContentError);
+            return;
+        }
+        writer->close();
+        QFile::resize(name, reply_pos);
+        total_size = run_written = reply_pos;
+        verify();
     }
+
+    else // request next pieces
+        scheduleNext();
+}
+
+// Check the checksum before finishing
+void HttpGet::verify()
+{
+    if (is_complete || verifier || writer == nullptr)
+        return;
+    writer->close();
+    if (writer->hasFailed()) // onWriteFailed() is still queued and will pause the task
+    {
+        writer->open(pieces.isEmpty());
+        return;
+    }
+    if (!pieces.isEmpty() && QFileInfo(name).size() > total_size)
+        QFile::resize(name, total_size);
+    if (checksum.isEmpty())
+    {
+        finish();
+        return;
+    }
+
+    // hash the file in another thread
+    setText(1, "Verify");
+    QString filename = name;
+    QCryptographicHash::Algorithm algorithm = checksum_algorithm;
+    verifier = new QFutureWatcher<QByteArray>(this);
+    connect(verifier, &QFutureWatcher<QByteArray>::finished, this, &HttpGet::onVerified);
+    verifier->setFuture(QtConcurrent::run([=]() {
+        QFile file(filename);
+        QCryptographicHash hash(algorithm);
+        if (!file.open(QFile::ReadOnly) || !hash.addData(&file))
+            return QByteArray();
+        return hash.result();
+    }));
+}
+
+void HttpGet::onVerified()
+{
+    QByteArray result = verifier->result();
+    verifier->deleteLater();
+    verifier = nullptr;
+    if (result == checksum)
+    {
+        finish();
+        return;
+    }
+
+    qDebug("Checksum mismatches: %s", name.toUtf8().constData());
+    // it cannot be known which part is broken, so download the whole file again once
+    if (++verify_failures > 1)
+    {
+        rate_limiter->remove(this);
+        QFile::remove(name + ".pieces");
+        emit finished(this, true);
+        return;
+    }
+    writer->open(pieces.isEmpty());
+    if (!pieces.isEmpty())
+        resetPieces(total_size);
+    emit progressChanged(0, true);
+    scheduleNext();
+}
+
+void HttpGet::finish()
+{
+    is_complete = true;
+    //close file
+    writer->close();
+    delete writer;
+    writer = 0;
+    rate_limiter->remove(this);
+    QFile::remove(name + ".pieces");
+    emit progressChanged(100, true);
+    emit dataReady();
+    emit finished(this, false);
 }
 
 void HttpGet::stop()
 {
     disconnect(SIGNAL(finished(HttpGet*, bool)));
-    if (!is_paused)
+    if (!is_paused && reply)
     {
         reply->disconnect();
         reply->abort();
         reply->deleteLater();
         reply = 0;
     }
-    file->close();
-    file->deleteLater();
-    file = 0;
+    rate_limiter->remove(this);
+    if (verifier)
+        verifier->disconnect();
+    is_paused = true;
+    if (writer)
+    {
+        // closing drains the writer, its queued signals must not reach this stopped task
+        writer->disconnect(this);
+        writer->close();
+        savePieces();
+        writer->deleteLater();
+        writer = 0;
+    }
 }
 
 void HttpGet::onReadyRead()
 {
-    file->write(reply->readAll());
+    // stop reading when the writer is busy, data will be left in socket
+    if (reply == nullptr || writer == nullptr || reply->bytesAvailable() == 0 || writer->isFull())
+        return;
+    writeData(reply->read(rate_limiter->take(this, reply->bytesAvailable())));
 }
 
-void HttpGet::onProgressChanged(qint64 received, qint64 total)
+void HttpGet::writeData(QByteArray data)
 {
-    bool is_percentage = (total > 0);
+    if (reply_end >= 0 && reply_pos + data.size() > reply_end)
+        data.truncate(reply_end - reply_pos);
+    if (data.isEmpty() || writer == nullptr)
+        return;
+    writer->write(reply_pos, data);
+    if (run_hash)
+        run_hash->addData(data);
+    qint64 prev_pos = reply_pos;
+    reply_pos += data.size();
+
+    // mark received pieces, requests always start at the beginning of a piece
+    if (!pieces.isEmpty())
+    {
+        for (int i = prev_pos / PIECE_SIZE; i < pieces.size(); i++)
+        {
+            if (qMin((qint64) (i + 1) * PIECE_SIZE, total_size) > reply_pos)
+                break;
+            received.setBit(i);
+        }
+    }
+}
+
+void HttpGet::onDataWritten(qint64 offset, qint64 size)
+{
+    if (is_complete || verifier || writer == nullptr)
+        return;
+    qint64 end = offset + size;
+    if (offset <= run_written && end > run_written)
+        run_written = end;
+
+    // writes are in order, so a received piece is written when its last byte is written
+    if (!pieces.isEmpty())
+    {
+        for (int i = offset / PIECE_SIZE; i < pieces.size() && (qint64) i * PIECE_SIZE < end; i++)
+        {
+            qint64 piece_end = qMin((qint64) (i + 1) * PIECE_SIZE, total_size);
+            if (piece_end > offset && piece_end <= end && received.testBit(i) && !pieces.testBit(i))
+            {
+                pieces.setBit(i);
+                finished_bytes += piece_end - (qint64) i * PIECE_SIZE;
+                unsaved_pieces++;
+            }
+        }
+        if (unsaved_pieces >= SAVE_INTERVAL)
+            savePieces();
+    }
+    updateProgress();
+    // make the data visible to StreamServer
+    emit dataReady();
+
+    // all pieces are written after the last request
+    if (reply == nullptr && !is_paused && !pieces.isEmpty() && finished_bytes == total_size)
+        verify();
+}
+
+// The data is lost, e.g. the disk is full, so stop the task without recording the pieces
+void HttpGet::onWriteFailed(qint64 offset, qint64 size, const QString &errorString)
+{
+    qDebug("Write file failed: %s\n%s", name.toUtf8().constData(), errorString.toUtf8().constData());
+    // pieces in the range must be received again, even if the rest of them is written
+    for (int i = offset / PIECE_SIZE; i < pieces.size() && (qint64) i * PIECE_SIZE < offset + size; i++)
+        received.clearBit(i);
+    if (is_paused || is_complete || verifier)
+        return;
+    if (reply)
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+        reply = nullptr;
+    }
+    delete run_hash;
+    run_hash = nullptr;
+    switching = false;
+    rate_limiter->remove(this);
+    is_paused = true;
+    emit paused(WRITE_FAILED);
+}
+
+// Bytes which can be read continuously from offset
+qint64 HttpGet::availableSize(qint64 offset)
+{
+    if (pieces.isEmpty())
+        return qMax(run_written - offset, (qint64) 0);
+    qint64 pos = offset;
+    while (pos < total_size)
+    {
+        int i = pos / PIECE_SIZE;
+        if (pieces.testBit(i))
+            pos = qMin((qint64) (i + 1) * PIECE_SIZE, total_size);
+        else if (pos >= reply_start && pos < run_written)
+            pos = run_written;
+        else
+            break;
+    }
+    return qMax(pos - offset, (qint64) 0);
+}
+
+void HttpGet::updateProgress()
+{
+    qint64 bytes = run_written;
+    if (!pieces.isEmpty()) // finished pieces and the unfinished part of current piece
+        bytes = finished_bytes + (run_written > reply_start ? run_written % PIECE_SIZE : 0);
+    bool is_percentage = (total_size > 0);
     int progress;
     if (is_percentage)  //Total size is known
-        progress = (last_finished + received) * 100 / (last_finished + total);
+        progress = bytes * 100 / total_size;
     else
-        progress = (received + last_finished) >> 20; //to MB
+        progress = bytes >> 20; //to MB
     if (progress != prev_progress)
     {
         prev_progress = progress;
@@ -128,10 +530,86 @@ void HttpGet::onProgressChanged(qint64 received, qint64 total)
     }
 }
 
+void HttpGet::loadPieces()
+{
+    QFile f(name + ".pieces");
+    if (!QFile::exists(name) || !f.open(QFile::ReadOnly))
+        return;
+    QDataStream in(&f);
+    qint64 total;
+    QBitArray bits;
+    in >> total >> bits;
+    // the validator and checksum are not saved by old versions
+    if (!in.atEnd())
+    {
+        qint32 algorithm;
+        in >> validator >> checksum >> algorithm;
+        checksum_algorithm = (QCryptographicHash::Algorithm) algorithm;
+    }
+    f.close();
+    if (in.status() != QDataStream::Ok || total <= 0 || bits.size() != (total + PIECE_SIZE - 1) / PIECE_SIZE)
+    {
+        validator.clear();
+        checksum.clear();
+        return;
+    }
+    total_size = total;
+    pieces = bits;
+    received = QBitArray(pieces.size());
+    // the file may be truncated since the last run, pieces beyond its end are downloaded again
+    qint64 size = QFileInfo(name).size();
+    for (int i = 0; i < pieces.size(); i++)
+    {
+        if (pieces.testBit(i) && qMin((qint64) (i + 1) * PIECE_SIZE, total_size) > size)
+            pieces.clearBit(i);
+        if (pieces.testBit(i))
+            finished_bytes += qMin((qint64) (i + 1) * PIECE_SIZE, total_size) - (qint64) i * PIECE_SIZE;
+    }
+    prev_progress = finished_bytes * 100 / total_size;
+}
+
+// Forget pieces in [from, to), they will be downloaded again
+void HttpGet::invalidate(qint64 from, qint64 to)
+{
+    for (int i = from / PIECE_SIZE; i < pieces.size() && (qint64) i * PIECE_SIZE < to; i++)
+    {
+        if (pieces.testBit(i))
+            finished_bytes -= qMin((qint64) (i + 1) * PIECE_SIZE, total_size) - (qint64) i * PIECE_SIZE;
+        pieces.clearBit(i);
+        received.clearBit(i);
+    }
+    savePieces();
+    updateProgress();
+}
+
+void HttpGet::resetPieces(qint64 total)
+{
+    total_size = total;
+    pieces = QBitArray((total + PIECE_SIZE - 1) / PIECE_SIZE);
+    received = QBitArray(pieces.size());
+    finished_bytes = 0;
+    checksum.clear();
+    savePieces();
+    writer->preallocate(total);
+}
+
+void HttpGet::savePieces()
+{
+    unsaved_pieces = 0;
+    if (pieces.isEmpty())
+        return;
+    QFile f(name + ".pieces");
+    if (!f.open(QFile::WriteOnly))
+        return;
+    QDataStream out(&f);
+    out << total_size << pieces << validator << checksum << (qint32) checksum_algorithm;
+    f.close();
+}
+
 void HttpGet::pause()
 {
     if (is_paused)
         start();
-    else
+    else if (reply)
         reply->abort();
 }
@@ -1,11 +1,23 @@
 #ifndef HTTPGET_H
 #define HTTPGET_H
 
+#include <QBitArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
 #include <QUrl>
 #include "downloaderitem.h"
 class QString;
-class QFile;
+class FileWriter;
 class QNetworkReply;
+template <typename T> class QFutureWatcher;
+
+/* Download a file by fixed-size pieces.
+ * Missing pieces after the priority offset (where the player reads) are requested first,
+ * then the rest. Finished pieces are recorded in "<file>.pieces", so the download can be resumed
+ * after restarting. If the server does not support "Range", the file is downloaded sequentially.
+ * Ranges checked by "Content-MD5" are downloaded again if they are broken, and the whole file is
+ * verified by the checksum in "Digest" or "x-goog-hash" if the server gives it.
+ */
 
 class HttpGet : public DownloaderItem
 {
@@ -16,19 +28,66 @@ public:
     void start(void);
     void stop(void);
 
+    // used by StreamServer to read the file while downloading
+    inline QString fileName() { return name; }
+    inline qint64 totalSize() { return total_size; }    // -1 if unknown
+    inline bool isComplete() { return is_complete; }
+    qint64 availableSize(qint64 offset);
+    void setPriorityOffset(qint64 offset);
+
+signals:
+    void dataReady(void);
+    void responded(int msecs);     // time from a request to its response headers
+
 private:
-    QFile *file;
+    FileWriter *writer;
     QString name;
     QUrl url;
     QNetworkReply *reply;
+    QBitArray pieces;       // finished pieces which are written, empty if pieces are not used
+    QBitArray received;     // pieces received but may not be written
+    qint64 total_size;
+    qint64 finished_bytes;  // size of finished pieces
+    qint64 reply_start;     // data in [reply_start, reply_pos) is received by the current reply
+    qint64 reply_pos;
+    qint64 run_written;     // data in [reply_start, run_written) is written
+    qint64 reply_end;       // -1 if not limited
+    qint64 priority_offset;
+    QElapsedTimer request_time;
+    QByteArray validator;   // ETag or Last-Modified, to know whether the file is changed on server
+    QByteArray checksum;    // checksum of the whole file, empty if unknown
+    QCryptographicHash::Algorithm checksum_algorithm;
+    QCryptographicHash *run_hash;   // hash of the current response if it has "Content-MD5"
+    QByteArray run_checksum;
+    QFutureWatcher<QByteArray> *verifier;
     int prev_progress;
-    qint64 last_finished;
+    int unsaved_pieces;
+    int verify_failures;
     bool is_paused;
+    bool is_complete;
+    bool switching;
+    bool bad_response;      // Content-Range does not match the request
+
+    void request(qint64 from, qint64 to);
+    void scheduleNext(void);
+    int nextPiece(void);
+    void verify(void);
+    void finish(void);
+    void invalidate(qint64 from, qint64 to);
+    void resetPieces(qint64 total);
+    void readChecksum(int status);
+    void loadPieces(void);
+    void savePieces(void);
+    void updateProgress(void);
+    void writeData(QByteArray data);
     
 private slots:
+    void onMetaDataChanged(void);
     void onFinished(void);
     void onReadyRead(void);
-    void onProgressChanged(qint64 received, qint64 total);
+    void onDataWritten(qint64 offset, qint64 size);
+    void onWriteFailed(qint64 offset, qint64 size, const QString &errorString);
+    void onVerified(void);
 };
 
 #endif // HTTPGET_H
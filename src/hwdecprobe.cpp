@@ -0,0 +1,108 @@
+#include "hwdecprobe.h"
+#include "settings_video.h"
+#include <QDebug>
+#include <QDir>
+#include <QSettings>
+
+#define MAX_FAILURES    3   // sessions
+
+HwdecProbe::HwdecProbe()
+{
+    // build decoder chain
+    if (!hasGpu())
+        hwdecChain << "no";
+    else
+    {
+#if defined(Q_OS_LINUX)
+        if (Settings::hwdec == "auto")
+            hwdecChain << "vaapi" << "vdpau";
+        else
+            hwdecChain << Settings::hwdec;
+#elif defined(Q_OS_MAC)
+        hwdecChain << "videotoolbox";
+#elif defined(Q_OS_WIN)
+        hwdecChain << "d3d11va";
+#endif
+        if (Settings::copyMode)
+        {
+            for (int i = 0; i < hwdecChain.size(); i++)
+                hwdecChain[i] += "-copy";
+        }
+        hwdecChain << "no";
+    }
+
+    // read results of previous probes
+    QSettings settings("moonsoft", "moonplayer");
+    settings.beginGroup("HwdecCaps");
+    foreach (QString key, settings.allKeys())
+        caps[key.section('/', 0, 0)][key.section('/', 1)] = settings.value(key).toBool();
+    settings.endGroup();
+    settings.beginGroup("HwdecFailures");
+    foreach (QString key, settings.allKeys())
+        failures[key.section('/', 0, 0)][key.section('/', 1)] = settings.value(key).toInt();
+    settings.endGroup();
+}
+
+
+// Check whether there is a GPU which can be used for decoding
+bool HwdecProbe::hasGpu()
+{
+#ifdef Q_OS_LINUX
+    static int result = -1;
+    if (result == -1)
+    {
+        QStringList filters;
+        filters << "renderD*" << "card*";
+        result = !QDir("/dev/dri").entryList(filters, QDir::System).isEmpty();
+        if (!result)
+            qDebug("No GPU found, use software decoding.");
+    }
+    return result;
+#else
+    return true;
+#endif
+}
+
+
+QString HwdecProbe::preferred(const QString &codec)
+{
+    const QHash<QString, bool> &results = caps[codec];
+    foreach (QString hwdec, hwdecChain)
+    {
+        if (results.value(hwdec, true))
+            return hwdec;
+    }
+    return "no";
+}
+
+
+void HwdecProbe::record(const QString &codec, const QString &hwdec, bool ok)
+{
+    if (codec.isEmpty() || hwdec == "no" || caps[codec].value(hwdec, !ok) == ok)
+        return;
+    qDebug("Hardware decoding of %s with %s: %s", codec.toUtf8().constData(),
+           hwdec.toUtf8().constData(), ok ? "supported" : "not supported");
+    caps[codec][hwdec] = ok;
+    QSettings settings("moonsoft", "moonplayer");
+    QString key = codec + '/' + hwdec;
+    if (ok)
+    {
+        failures[codec].remove(hwdec);
+        settings.remove("HwdecFailures/" + key);
+        settings.setValue("HwdecCaps/" + key, true);
+        return;
+    }
+
+    // only the next decoder is tried in this session, save the failure if it happens again and again
+    int n = ++failures[codec][hwdec];
+    if (n >= MAX_FAILURES)
+    {
+        settings.remove("HwdecFailures/" + key);
+        settings.setValue("HwdecCaps/" + key, false);
+    }
+    else
+    {
+        settings.remove("HwdecCaps/" + key);
+        settings.setValue("HwdecFailures/" + key, n);
+    }
+}
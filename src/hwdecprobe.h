@@ -0,0 +1,29 @@
+#ifndef HWDECPROBE_H
+#define HWDECPROBE_H
+
+#include <QHash>
+#include <QStringList>
+
+/* Record which codecs can actually be decoded by each hardware decoder on this machine.
+ * mpv silently falls back to software decoding when the hardware decoder does not support a codec,
+ * so PlayerCore reports the result from "hwdec-current" after each file is loaded,
+ * and the next decoder in the chain is tried. A failure may be transient, so it only holds for the
+ * current session, and is saved after the decoder fails in several sessions in a row.
+ */
+
+class HwdecProbe
+{
+public:
+    HwdecProbe();
+    static bool hasGpu(void);
+    inline const QStringList &chain() { return hwdecChain; }
+    QString preferred(const QString &codec);  // Return the first decoder in chain not known to fail
+    void record(const QString &codec, const QString &hwdec, bool ok);
+
+private:
+    QStringList hwdecChain;
+    QHash<QString, QHash<QString, bool> > caps;
+    QHash<QString, QHash<QString, int> > failures;  // sessions in a row in which the decoder fails
+};
+
+#endif // HWDECPROBE_H
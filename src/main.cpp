@@ -2,6 +2,7 @@
 #include <QTranslator>
 #include "settingsdialog.h"
 #include "accessmanager.h"
+#include "ratelimiter.h"
 #include <locale.h>
 #include <QDebug>
 #include <QDir>
@@ -10,7 +11,9 @@
 #include "platform/application.h"
 #include "platform/detectopengl.h"
 #include "platform/paths.h"
+#include "mediaindexer.h"
 #include "playerview.h"
+#include "parserrouter.h"
 #include "parserykdl.h"
 #include "parseryoutubedl.h"
 #include "parserwebcatch.h"
@@ -30,6 +33,7 @@ int main(int argc, char *argv[])
 
     //init
     access_manager = new NetworkAccessManager(&a);
+    rate_limiter = new RateLimiter(&a);
     printf("Initialize settings...\n");
     initSettings();
 
@@ -46,6 +50,9 @@ int main(int argc, char *argv[])
     if (translator.load("moonplayer_" + QLocale::system().name(), getAppPath() + "/translations"))
         a.installTranslator(&translator);
 
+    // Create media indexer
+    media_indexer = new MediaIndexer;
+
     // Create window
     PlayerView *player_view = new PlayerView;
     player_view->show();
@@ -54,9 +61,11 @@ int main(int argc, char *argv[])
     parser_ykdl = new ParserYkdl(&a);
     parser_youtubedl = new ParserYoutubeDL(&a);
     parser_webcatch = new ParserWebCatch(&a);
+    parser_router = new ParserRouter(&a);
 
     a.exec();
-    Py_Finalize();
+    finalizePython();
     delete player_view;
+    delete media_indexer;
     return 0;
 }
@@ -0,0 +1,372 @@
+#include "mediaindexer.h"
+#include "platform/paths.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QThread>
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#define MAX_ENTRIES             20000
+#define EVICT_INTERVAL          500     // Check the store size after every 500 insertions
+#define KEYFRAME_SCAN_PACKETS   600     // Packets to read if the container has no index
+
+MediaIndexer *media_indexer = nullptr;
+
+
+/* Runs in the thread pool. If the size and the modification time are the same as the indexed ones,
+ * the file is not opened again.
+ */
+class ProbeTask : public QRunnable
+{
+public:
+    ProbeTask(MediaIndexer *indexer, const QString &file, qint64 size, qint64 mtime) :
+        indexer(indexer), file(file), known_size(size), known_mtime(mtime)
+    {
+        generation = indexer->generation.load();
+    }
+    void run();
+
+private:
+    MediaIndexer *indexer;
+    QString file;
+    qint64 known_size;
+    qint64 known_mtime;
+    int generation;
+
+    MediaInfo probe(void);
+    double keyframeInterval(AVFormatContext *ctx, int video);
+    static int interruptCallback(void *opaque);
+};
+
+
+void ProbeTask::run()
+{
+    QThread::currentThread()->setPriority(QThread::IdlePriority);
+    if (indexer->generation.load() != generation)
+        return;
+
+    QFileInfo fi(file);
+    qint64 size = fi.exists() ? fi.size() : -1;
+    qint64 mtime = fi.exists() ? fi.lastModified().toMSecsSinceEpoch() : -1;
+    bool changed = (size != known_size || mtime != known_mtime);
+    MediaInfo info;
+    if (changed && size >= 0)
+        info = probe();
+
+    if (indexer->generation.load() != generation)
+        return;
+    QMetaObject::invokeMethod(indexer, "onProbed", Qt::QueuedConnection,
+                              Q_ARG(QString, file), Q_ARG(qint64, size), Q_ARG(qint64, mtime),
+                              Q_ARG(bool, changed), Q_ARG(MediaInfo, info));
+}
+
+
+int ProbeTask::interruptCallback(void *opaque)
+{
+    ProbeTask *task = (ProbeTask*) opaque;
+    return task->indexer->generation.load() != task->generation;
+}
+
+
+MediaInfo ProbeTask::probe()
+{
+    MediaInfo info;
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (ctx == nullptr)
+        return info;
+    ctx->interrupt_callback.callback = interruptCallback;
+    ctx->interrupt_callback.opaque = this;
+    if (avformat_open_input(&ctx, file.toUtf8().constData(), nullptr, nullptr) < 0) // ctx is freed on failure
+        return info;
+    if (avformat_find_stream_info(ctx, nullptr) < 0)
+    {
+        avformat_close_input(&ctx);
+        return info;
+    }
+
+    if (ctx->duration != AV_NOPTS_VALUE && ctx->duration > 0)
+        info.duration = (ctx->duration + AV_TIME_BASE / 2) / AV_TIME_BASE;
+
+    int video = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    int audio = av_find_best_stream(ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    // tracks are listed in the same order as mpv's track ids
+    for (unsigned i = 0; i < ctx->nb_streams; i++)
+    {
+        AVStream *stream = ctx->streams[i];
+        AVDictionaryEntry *title = av_dict_get(stream->metadata, "title", nullptr, 0);
+        QString name = title ? QString::fromUtf8(title->value) : QString();
+        if (stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            info.audioTracks << name;
+        else if (stream->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE)
+            info.subtitleTracks << name;
+        stream->discard = ((int) i == video) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+
+    if (video >= 0)
+    {
+        AVCodecParameters *par = ctx->streams[video]->codecpar;
+        info.width = par->width;
+        info.height = par->height;
+        info.videoCodec = avcodec_get_name(par->codec_id);
+        info.keyframeInterval = keyframeInterval(ctx, video);
+    }
+    if (audio >= 0)
+        info.audioCodec = avcodec_get_name(ctx->streams[audio]->codecpar->codec_id);
+
+    avformat_close_input(&ctx);
+    return info;
+}
+
+
+// Use the index of the container (mp4, mkv cues) if possible, otherwise read the first packets
+double ProbeTask::keyframeInterval(AVFormatContext *ctx, int video)
+{
+    AVStream *stream = ctx->streams[video];
+    int64_t first = AV_NOPTS_VALUE, last = AV_NOPTS_VALUE;
+    int keyframes = 0;
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    int n_entries = avformat_index_get_entries_count(stream);
+#else
+    int n_entries = stream->nb_index_entries;
+#endif
+    for (int i = 0; i < n_entries; i++)
+    {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+#else
+        const AVIndexEntry *entry = &stream->index_entries[i];
+#endif
+        if (entry->flags & AVINDEX_KEYFRAME)
+        {
+            if (first == AV_NOPTS_VALUE)
+                first = entry->timestamp;
+            last = entry->timestamp;
+            keyframes++;
+        }
+    }
+
+    if (keyframes < 2)
+    {
+        first = last = AV_NOPTS_VALUE;
+        keyframes = 0;
+        AVPacket *pkt = av_packet_alloc();
+        int n = 0;
+        while (n < KEYFRAME_SCAN_PACKETS && av_read_frame(ctx, pkt) >= 0)
+        {
+            if (pkt->stream_index == video)
+            {
+                n++;
+                if ((pkt->flags & AV_PKT_FLAG_KEY) && pkt->pts != AV_NOPTS_VALUE)
+                {
+                    if (first == AV_NOPTS_VALUE)
+                        first = pkt->pts;
+                    last = pkt->pts;
+                    keyframes++;
+                }
+            }
+            av_packet_unref(pkt);
+        }
+        av_packet_free(&pkt);
+    }
+
+    if (keyframes < 2 || last <= first)
+        return -1;
+    return (last - first) * av_q2d(stream->time_base) / (keyframes - 1);
+}
+
+
+MediaIndexer::MediaIndexer(QObject *parent) : QObject(parent)
+{
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();
+#endif
+    qRegisterMetaType<MediaInfo>("MediaInfo");
+    // probing is disk-bound, more threads only make the playback stutter
+    pool.setMaxThreadCount(1);
+    n_inserted = 0;
+
+    db = QSqlDatabase::addDatabase("QSQLITE", "media_index");
+    db.setDatabaseName(QDir(getUserPath()).filePath("media_index.sqlite"));
+    ok = db.open();
+    if (!ok)
+    {
+        qDebug("[MediaIndexer] Cannot open database: %s", db.lastError().text().toUtf8().constData());
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.exec("PRAGMA journal_mode=WAL");
+    query.exec("PRAGMA synchronous=NORMAL");
+    ok = query.exec("CREATE TABLE IF NOT EXISTS media ("
+                    "path TEXT PRIMARY KEY, "
+                    "size INTEGER NOT NULL, "
+                    "mtime INTEGER NOT NULL, "
+                    "duration INTEGER, "
+                    "width INTEGER, "
+                    "height INTEGER, "
+                    "video_codec TEXT, "
+                    "audio_codec TEXT, "
+                    "audio_tracks TEXT, "
+                    "subtitle_tracks TEXT, "
+                    "keyframe_interval REAL, "
+                    "indexed INTEGER NOT NULL)");
+    if (!ok)
+    {
+        qDebug("[MediaIndexer] Cannot create table: %s", query.lastError().text().toUtf8().constData());
+        return;
+    }
+    query.exec("CREATE INDEX IF NOT EXISTS media_indexed ON media(indexed)");
+    evict();
+    loadRecords();
+}
+
+MediaIndexer::~MediaIndexer()
+{
+    cancelRequests();
+    pool.waitForDone();
+    if (db.isOpen())
+        db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("media_index");
+}
+
+
+bool MediaIndexer::isLocal(const QString &file)
+{
+    return !file.isEmpty() && !file.contains("://");
+}
+
+
+void MediaIndexer::loadRecords()
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT path, size, mtime, duration, width, height, video_codec, audio_codec, "
+                    "audio_tracks, subtitle_tracks, keyframe_interval FROM media"))
+        return;
+    while (query.next())
+    {
+        Record record;
+        record.size = query.value(1).toLongLong();
+        record.mtime = query.value(2).toLongLong();
+        record.info.duration = query.value(3).toInt();
+        record.info.width = query.value(4).toInt();
+        record.info.height = query.value(5).toInt();
+        record.info.videoCodec = query.value(6).toString();
+        record.info.audioCodec = query.value(7).toString();
+        if (!query.value(8).isNull())
+            record.info.audioTracks = query.value(8).toString().split('\n');
+        if (!query.value(9).isNull())
+            record.info.subtitleTracks = query.value(9).toString().split('\n');
+        record.info.keyframeInterval = query.value(10).toDouble();
+        records[query.value(0).toString()] = record;
+    }
+}
+
+
+bool MediaIndexer::lookup(const QString &file, MediaInfo *info)
+{
+    if (!isLocal(file))
+        return false;
+    QFileInfo fi(file);
+    QHash<QString, Record>::const_iterator it = records.constFind(fi.absoluteFilePath());
+    if (it == records.constEnd() || it->size != fi.size() || it->mtime != fi.lastModified().toMSecsSinceEpoch())
+        return false;
+    *info = it->info;
+    return true;
+}
+
+
+void MediaIndexer::request(const QString &file, bool urgent)
+{
+    if (!isLocal(file))
+        return;
+    QString path = QFileInfo(file).absoluteFilePath();
+    // a queued probe which becomes urgent is queued again ahead of the others
+    QHash<QString, bool>::iterator pending = probing.find(path);
+    if (pending != probing.end() && (pending.value() || !urgent))
+        return;
+    probing[path] = urgent;
+    QHash<QString, Record>::const_iterator it = records.constFind(path);
+    qint64 size = (it == records.constEnd()) ? -1 : it->size;
+    qint64 mtime = (it == records.constEnd()) ? -1 : it->mtime;
+    pool.start(new ProbeTask(this, file, size, mtime), urgent ? 1 : 0);
+}
+
+
+void MediaIndexer::cancelRequests()
+{
+    generation.ref();
+    pool.clear();
+    probing.clear();
+}
+
+
+void MediaIndexer::onProbed(const QString &file, qint64 size, qint64 mtime, bool changed, const MediaInfo &info)
+{
+    QString path = QFileInfo(file).absoluteFilePath();
+    probing.remove(path);
+    if (size < 0) // removed
+        return;
+    if (changed)
+    {
+        Record record;
+        record.size = size;
+        record.mtime = mtime;
+        record.info = info;
+        records[path] = record;
+        save(path, record);
+    }
+    emit indexed(file, records[path].info);
+}
+
+
+void MediaIndexer::save(const QString &path, const Record &record)
+{
+    if (!ok)
+        return;
+    const MediaInfo &info = record.info;
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO media (path, size, mtime, duration, width, height, video_codec, "
+                  "audio_codec, audio_tracks, subtitle_tracks, keyframe_interval, indexed) "
+                  "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    query.addBindValue(path);
+    query.addBindValue(record.size);
+    query.addBindValue(record.mtime);
+    query.addBindValue(info.duration);
+    query.addBindValue(info.width);
+    query.addBindValue(info.height);
+    query.addBindValue(info.videoCodec);
+    query.addBindValue(info.audioCodec);
+    // NULL for no tracks, an empty string is a single track without title
+    query.addBindValue(info.audioTracks.isEmpty() ? QVariant(QVariant::String) : info.audioTracks.join('\n'));
+    query.addBindValue(info.subtitleTracks.isEmpty() ? QVariant(QVariant::String) : info.subtitleTracks.join('\n'));
+    query.addBindValue(info.keyframeInterval);
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    if (!query.exec())
+    {
+        qDebug("[MediaIndexer] Cannot save: %s", query.lastError().text().toUtf8().constData());
+        return;
+    }
+    n_inserted++;
+    if (n_inserted % EVICT_INTERVAL == 0)
+        evict();
+}
+
+
+// Remove the entries indexed earliest, they are dropped from memory at next startup
+void MediaIndexer::evict()
+{
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM media WHERE path NOT IN "
+                  "(SELECT path FROM media ORDER BY indexed DESC LIMIT ?)");
+    query.addBindValue(MAX_ENTRIES);
+    query.exec();
+}
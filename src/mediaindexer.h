@@ -0,0 +1,74 @@
+#ifndef MEDIAINDEXER_H
+#define MEDIAINDEXER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QThreadPool>
+
+struct MediaInfo
+{
+    MediaInfo() : duration(-1), width(0), height(0), keyframeInterval(-1) {}
+    int duration;                   // in seconds, -1 if unknown
+    int width;
+    int height;
+    QString videoCodec;
+    QString audioCodec;
+    QStringList audioTracks;        // titles of the embedded tracks in order, may be empty strings
+    QStringList subtitleTracks;
+    double keyframeInterval;        // average seconds between keyframes, -1 if unknown
+};
+Q_DECLARE_METATYPE(MediaInfo)
+
+/* Probes local media files with libavformat on a low-priority thread pool.
+ * Results are kept in a SQLite database keyed by path, and are valid as long as the size and the
+ * modification time of the file do not change. The whole index is loaded into memory at startup,
+ * database writes happen in the main thread only.
+ */
+
+class MediaIndexer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MediaIndexer(QObject *parent = nullptr);
+    ~MediaIndexer();
+    bool lookup(const QString &file, MediaInfo *info);      // Return false if the file is not indexed or changed
+    void request(const QString &file, bool urgent = false); // Probe in background, then emit indexed()
+    void cancelRequests(void);
+
+    static bool isLocal(const QString &file);
+
+signals:
+    void indexed(const QString &file, const MediaInfo &info);
+
+private slots:
+    void onProbed(const QString &file, qint64 size, qint64 mtime, bool changed, const MediaInfo &info);
+
+private:
+    struct Record
+    {
+        qint64 size;
+        qint64 mtime;
+        MediaInfo info;
+    };
+    QHash<QString, Record> records;
+    QHash<QString, bool> probing;   // path -> urgent
+    QThreadPool pool;
+    QAtomicInt generation;      // increased to cancel pending probes
+    QSqlDatabase db;
+    bool ok;
+    int n_inserted;
+
+    void loadRecords(void);
+    void save(const QString &path, const Record &record);
+    void evict(void);
+
+    friend class ProbeTask;
+};
+
+extern MediaIndexer *media_indexer;
+
+#endif // MEDIAINDEXER_H
@@ -5,7 +5,7 @@
 #-------------------------------------------------
 
 
-QT += core gui network xml widgets websockets webenginewidgets
+QT += core gui concurrent network sql widgets websockets webenginewidgets
 unix:!macx: QT += gui-private x11extras
 
 macx:  TARGET = MoonPlayer
@@ -24,27 +24,42 @@ SOURCES += \
     downloader.cpp \
     downloaderitem.cpp \
     extractor.cpp \
+    ffmpegjob.cpp \
+    filewriter.cpp \
     httpget.cpp \
+    hwdecprobe.cpp \
     main.cpp \
+    mediaindexer.cpp \
     mybuttongroup.cpp \
     mylistwidget.cpp \
     parserbase.cpp \
+    parserrouter.cpp \
     parserwebcatch.cpp \
     parserykdl.cpp \
     parseryoutubedl.cpp \
     playercore.cpp \
     playerview.cpp \
     playlist.cpp \
+    playlistloader.cpp \
+    playlistmodel.cpp \
+    postprocessor.cpp \
     pyapi.cpp \
+    ratelimiter.cpp \
     python_wrapper.cpp \
+    pythonthread.cpp \
     reslibrary.cpp \
+    resourceblocker.cpp \
     resplugin.cpp \
     selectiondialog.cpp \
     settingsdialog.cpp \
     skin.cpp \
     streamget.cpp \
+    streammuxer.cpp \
+    streamserver.cpp \
+    thumbnailer.cpp \
     utils.cpp \
     videocombiner.cpp \
+    watchhistory.cpp \
     platform/paths.cpp
 
 HEADERS  +=\
@@ -58,19 +73,30 @@ HEADERS  +=\
     downloader.h \
     downloaderitem.h \
     extractor.h \
+    ffmpegjob.h \
+    filewriter.h \
     httpget.h \
+    hwdecprobe.h \
+    mediaindexer.h \
     mybuttongroup.h \
     mylistwidget.h \
     parserbase.h \
+    parserrouter.h \
     parserwebcatch.h \
     parserykdl.h \
     parseryoutubedl.h \
     playercore.h \
     playerview.h \
     playlist.h \
+    playlistloader.h \
+    playlistmodel.h \
+    postprocessor.h \
     pyapi.h \
+    ratelimiter.h \
     python_wrapper.h \
+    pythonthread.h \
     reslibrary.h \
+    resourceblocker.h \
     resplugin.h \
     selectiondialog.h \
     settings_audio.h \
@@ -80,8 +106,12 @@ HEADERS  +=\
     settingsdialog.h \
     skin.h \
     streamget.h \
+    streammuxer.h \
+    streamserver.h \
+    thumbnailer.h \
     utils.h \
     videocombiner.h \
+    watchhistory.h \
     platform/application.h \
     platform/detectopengl.h \
     platform/paths.h \
@@ -168,7 +198,7 @@ win32: RC_FILE = icon.rc
 # Libraries
 unix:!macx {
     CONFIG += link_pkgconfig
-    PKGCONFIG += python3 mpv
+    PKGCONFIG += python3 mpv libcrypto libavformat libavcodec libavutil libswscale
     INCLUDEPATH += $$PREFIX/include/qtermwidget5
     LIBS += -lqtermwidget5
 }
@@ -179,7 +209,9 @@ macx {
     LIBS += -F /System/Library/Frameworks -framework CoreFoundation \
         -L/usr/lib -ldl \
         -L/System/Library/Frameworks/Python.framework/Versions/2.7/lib/python2.7/config -lpython2.7 \
-        -L/usr/local/lib -lmpv
+        -L/usr/local/lib -lmpv -lavformat -lavcodec -lavutil -lswscale \
+        -L/usr/local/opt/openssl/lib -lcrypto
+    INCLUDEPATH += /usr/local/opt/openssl/include
 }
 
 DISTFILES += \
@@ -11,10 +11,12 @@
 #include "selectiondialog.h"
 #include "settings_network.h"
 #include "platform/terminal.h"
+#include "parserrouter.h"
 #include "parserykdl.h"
 #include "parseryoutubedl.h"
 #include "extractor.h"
 #include "parserwebcatch.h"
+#include "watchhistory.h"
 
 
 SelectionDialog *ParserBase::selectionDialog = nullptr;
@@ -74,6 +76,10 @@ void ParserBase::finishParsing()
         }
     }
 
+    // Stream urls usually expire, so remember the playback position by the page url
+    for (int i = 0; i < result.urls.size(); i++)
+        WatchHistory::bindOrigin(result.urls[i], QString("%1#%2").arg(url, QString::number(i)));
+
     // replace illegal chars in title with .
     static QRegularExpression illegalChars("[\\\\/]");
     result.title.replace(illegalChars, ".");
@@ -166,12 +172,16 @@ void upgradeParsers()
 
 void parseUrl(const QString &url, bool download)
 {
-    QString host = QUrl(url).host();
-    if (Extractor::isSupported(host))
+    switch (parser_router->route(QUrl(url).host()))
+    {
+    case ParserRouter::WEBCATCH:
         parser_webcatch->parse(url, download);
-    else if (ParserYkdl::isSupported(host))
+        break;
+    case ParserRouter::YKDL:
         parser_ykdl->parse(url, download);
-    else
+        break;
+    default:
         parser_youtubedl->parse(url, download);
+    }
 }
 
@@ -0,0 +1,78 @@
+#include "parserrouter.h"
+#include "extractor.h"
+#include "platform/paths.h"
+#include <QDir>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+#define RELOAD_DELAY    1000    // ms
+
+ParserRouter *parser_router = nullptr;
+
+ParserRouter::ParserRouter(QObject *parent) : QObject(parent)
+{
+    extractorsPath = getUserPath() + "/ykdl/ykdl/extractors";
+    // upgrade-ykdl.sh removes the whole ykdl directory and moves the new one in
+    watcher = new QFileSystemWatcher(this);
+    watcher->addPath(getUserPath());
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &ParserRouter::onDirectoryChanged);
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(RELOAD_DELAY);
+    connect(reloadTimer, &QTimer::timeout, this, &ParserRouter::loadYkdl);
+    loadYkdl();
+}
+
+void ParserRouter::loadYkdl()
+{
+    routes.clear();
+    foreach (QString host, Extractor::getSupportedHosts())
+        routes[host] = WEBCATCH;
+
+    ykdlNames.clear();
+    QDir extractorsDir(extractorsPath);
+    QStringList extractors = extractorsDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot);
+    foreach (QString name, extractors)
+    {
+        if (name.endsWith(".py"))
+            name.chop(3);
+        if (name != "__init__" && name != "__pycache__")
+            ykdlNames << name;
+    }
+    if (extractorsDir.exists() && !watcher->directories().contains(extractorsPath))
+        watcher->addPath(extractorsPath);
+}
+
+void ParserRouter::onDirectoryChanged(const QString &path)
+{
+    // the user directory is also written by the watch history, the media index, thumbnails, etc.,
+    // only the appearance or removal of the extractors directory matters there
+    if (path == getUserPath() && watcher->directories().contains(extractorsPath) == QDir(extractorsPath).exists())
+        return;
+    reloadTimer->start();
+}
+
+ParserRouter::Backend ParserRouter::route(const QString &host)
+{
+    if (routes.contains(host))
+        return routes[host];
+
+    // find the site's name from the right, e.g. "youku" in "v.youku.com" and "sohu" in "tv.sohu.com.cn"
+    static const QSet<QString> generic = {"com", "net", "org", "edu", "gov", "co", "tv", "www"};
+    QStringList labels = host.split('.');
+    labels.removeLast();    // top level domain
+    Backend backend = YOUTUBEDL;
+    while (!labels.isEmpty())
+    {
+        QString label = labels.takeLast();
+        if (ykdlNames.contains(label))
+        {
+            backend = YKDL;
+            break;
+        }
+        if (!generic.contains(label))
+            break;
+    }
+    routes[host] = backend;
+    return backend;
+}
@@ -0,0 +1,37 @@
+#ifndef PARSERROUTER_H
+#define PARSERROUTER_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+class QFileSystemWatcher;
+class QTimer;
+
+/* Choose the parser for a host by one hash lookup.
+ * Hosts of web-catch extractors and names of ykdl's extractors are read once. The ykdl part is read again
+ * when upgrade-ykdl.sh replaces its directory. Other hosts are parsed by youtube-dl.
+ */
+
+class ParserRouter : public QObject
+{
+    Q_OBJECT
+public:
+    enum Backend {WEBCATCH, YKDL, YOUTUBEDL};
+    explicit ParserRouter(QObject *parent = nullptr);
+    Backend route(const QString &host);
+
+private:
+    QFileSystemWatcher *watcher;
+    QTimer *reloadTimer;                // an upgrade changes the directories many times
+    QHash<QString, Backend> routes;     // cache of all looked up hosts
+    QSet<QString> ykdlNames;            // e.g. "youku" for youku.com
+    QString extractorsPath;
+    void loadYkdl(void);
+
+private slots:
+    void onDirectoryChanged(const QString &path);
+};
+
+extern ParserRouter *parser_router;
+
+#endif // PARSERROUTER_H
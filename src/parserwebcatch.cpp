@@ -8,6 +8,7 @@
 #include "accessmanager.h"
 #include "chromiumdebugger.h"
 #include "extractor.h"
+#include "resourceblocker.h"
 #include "selectiondialog.h"
 
 ParserWebCatch *parser_webcatch;
@@ -25,6 +26,9 @@ ParserWebCatch::ParserWebCatch(QObject *parent) :
     profile->settings()->setAttribute(QWebEngineSettings::AutoLoadImages, false);
     profile->settings()->setAttribute(QWebEngineSettings::AutoLoadIconsForPage, false);
     connect(profile->cookieStore(), &QWebEngineCookieStore::cookieAdded, this, &ParserWebCatch::onCookieAdded);
+    resourceBlocker = new ResourceBlocker(this);
+    profile->setRequestInterceptor(resourceBlocker);
+    loadedBytes = 0;
     profile->cookieStore()->loadAllCookies();
 
     // create chromium instance
@@ -33,96 +37,105 @@ ParserWebCatch::ParserWebCatch(QObject *parent) :
 
     // create debugger
     chromiumDebugger = new ChromiumDebugger(this);
+    chromiumDebugger->setEventFilter(QStringList() << "Network.responseReceived"
+                                     << "Network.loadingFinished" << "Network.loadingFailed");
     connect(chromiumDebugger, &ChromiumDebugger::connected, this, &ParserWebCatch::onChromiumConnected);
     connect(chromiumDebugger, &ChromiumDebugger::eventReceived, this, &ParserWebCatch::onChromiumEvent);
-    connect(chromiumDebugger, &ChromiumDebugger::resultReceived, this, &ParserWebCatch::onChromiumResult);
     chromiumDebugger->open(19260);
 }
 
 void ParserWebCatch::onChromiumConnected()
 {
     // enable network monitoring
-    chromiumDebugger->send(1, "Network.enable");
+    chromiumDebugger->call("Network.enable");
 }
 
 /* Start parsing */
 void ParserWebCatch::runParser(const QString &url)
 {
     // Check if URL is supported
-    if (!Extractor::isSupported(QUrl(url).host()))
+    Extractor *extractor = Extractor::getExtractorByHost(QUrl(url).host());
+    if (extractor == nullptr)
     {
         showErrorDialog(tr("This URL is not supported now!"));
         return;
     }
 
     // load url
+    resourceBlocker->reset(extractor->getAllowedResources());
+    parseTime.start();
+    loadedBytes = 0;
+    catchedRequests.clear();
     webengineView->setUrl(QUrl(url));
     webengineView->show();
 }
 
 /* Monitor network traffic */
-void ParserWebCatch::onChromiumEvent(int id, const QString &method, const QVariantHash &params)
+void ParserWebCatch::onChromiumEvent(const QString &method, const QJsonObject &params)
 {
-    Q_UNUSED(id);
     if (method == "Network.responseReceived") // Check if url matches
     {
-        QString url = params["response"].toHash()["url"].toString();
+        QString url = params["response"].toObject()["url"].toString();
         Extractor *match = Extractor::getMatchedExtractor(url);
         if (match)
-        {
-            matchedExtractor = match;
-            catchedRequestId = params["requestId"].toString();
-        }
+            catchedRequests[params["requestId"].toString()] = match;
     }
-    else if (method == "Network.loadingFinished" && matchedExtractor) // Catching finished, request body
+    else if (method == "Network.loadingFinished") // Catching finished, request body
     {
-        QString requestId = params["requestId"].toString();
-        if (requestId == catchedRequestId)
-        {
-            QVariantHash newParams;
-            newParams["requestId"] = catchedRequestId;
-            chromiumDebugger->send(1, "Network.getResponseBody", newParams);
-        }
+        loadedBytes += params["encodedDataLength"].toDouble();
+        Extractor *extractor = catchedRequests.take(params["requestId"].toString());
+        if (extractor == nullptr)
+            return;
+        QJsonObject newParams;
+        newParams["requestId"] = params["requestId"];
+        // read body, each call knows its own extractor
+        chromiumDebugger->call("Network.getResponseBody", newParams, [=](const QJsonObject &result, const QString &error) {
+            if (!error.isEmpty())
+            {
+                showErrorDialog(tr("Fails to get the response: ") + error);
+                return;
+            }
+            QString err = extractor->parse(result["body"].toString());
+            if (!err.isEmpty())
+                showErrorDialog(err);
+        });
     }
+    else if (method == "Network.loadingFailed")
+        catchedRequests.remove(params["requestId"].toString());
 }
 
-// read body
-void ParserWebCatch::onChromiumResult(int id, const QVariantHash &result)
-{
-    Q_UNUSED(id);
-    if (result.contains("body"))
-    {
-        QByteArray data = result["body"].toString().toUtf8();
-        QString err = matchedExtractor->parse(data);
-        if (!err.isEmpty())
-            showErrorDialog(err);
-        matchedExtractor = nullptr;
-    }
-}
-
-// finish parsing
-void ParserWebCatch::onParseFinished(const QVariantHash &data)
+// finish parsing, called from Python with the GIL held
+void ParserWebCatch::onParseFinished(const PyDictView &data)
 {
     webengineView->setUrl(QUrl("about:blank"));
     webengineView->close();
+    qDebug("[webcatch] Parsed in %lld ms, %lld KB loaded, %d requests blocked (%s)",
+           parseTime.elapsed(), loadedBytes >> 10, resourceBlocker->blockedCount(),
+           resourceBlocker->summary().toUtf8().constData());
 
     result.title = data["title"].toString();
     result.danmaku_url = data["danmaku_url"].toString();
 
     // read streams
-    QVariantList streams = data["streams"].toList();
     QStringList stream_types;
-    foreach (QVariant item, streams)
-        stream_types << item.toHash()["type"].toString();
+    QList<QStringList> stream_srcs;
+    foreach (PyDictView item, data.dictList("streams"))
+    {
+        stream_types << item["type"].toString();
+        stream_srcs << item["srcs"].toStringList();
+    }
 
-    // select video quality
-    int selected = selectionDialog->showDialog_Index(stream_types,
-                                                     tr("Please select a video quality:"));
+    // select video quality, the python thread must not wait for the dialog
+    int selected;
+    Py_BEGIN_ALLOW_THREADS
+    selected = selectionDialog->showDialog_Index(stream_types,
+                                                 tr("Please select a video quality:"));
+    Py_END_ALLOW_THREADS
     if (selected == -1) // no item selected
         return;
 
     // Set source urls
-    result.urls = streams[selected].toHash()["srcs"].toStringList();
+    result.urls = stream_srcs[selected];
 
     // find out container
     if (!result.urls.isEmpty())
@@ -2,9 +2,14 @@
 #define PARSERWEBCATCH_H
 
 #include "parserbase.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
 class ChromiumDebugger;
 class Extractor;
+class PyDictView;
 class QNetworkCookie;
+class ResourceBlocker;
 class QWebEngineView;
 
 class ParserWebCatch : public ParserBase
@@ -12,20 +17,21 @@ class ParserWebCatch : public ParserBase
     Q_OBJECT
 public:
     ParserWebCatch(QObject *parent = 0);
-    void onParseFinished(const QVariantHash &data);
+    void onParseFinished(const PyDictView &data);
 
 protected:
     void runParser(const QString &url);
 
 private slots:
     void onChromiumConnected(void);
-    void onChromiumEvent(int id, const QString &method, const QVariantHash &params);
-    void onChromiumResult(int id, const QVariantHash &result);
+    void onChromiumEvent(const QString &method, const QJsonObject &params);
     void onCookieAdded(const QNetworkCookie &cookie);
 
 private:
-    Extractor *matchedExtractor;
-    QString catchedRequestId;
+    QHash<QString, Extractor*> catchedRequests;   // request id -> extractor of its url
+    ResourceBlocker *resourceBlocker;
+    QElapsedTimer parseTime;
+    qint64 loadedBytes;
     QWebEngineView *webengineView;
     ChromiumDebugger *chromiumDebugger;
 };
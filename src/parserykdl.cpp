@@ -3,7 +3,6 @@
 #include "python_wrapper.h"
 #include "selectiondialog.h"
 #include "settings_network.h"
-#include <QDir>
 #include <QGridLayout>
 #include <QLabel>
 #include <QJsonArray>
@@ -31,17 +30,6 @@ ParserYkdl::~ParserYkdl()
     }
 }
 
-bool ParserYkdl::isSupported(const QString &host)
-{
-    QDir extractorsDir(getUserPath() + "/ykdl/ykdl/extractors");
-    QStringList extractors = extractorsDir.entryList(QDir::AllEntries | QDir::NoDotAndDotDot);
-    QString shortName = host.section('.', -2, -2);
-    if (shortName == "com" || shortName == "net" || shortName == "org")
-        shortName = host.section('.', -3, -3);
-    return extractors.contains(shortName) || extractors.contains(shortName + ".py");
-}
-
-
 void ParserYkdl::runParser(const QString &url)
 {
     if (process->state() == QProcess::Running)
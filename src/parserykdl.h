@@ -13,7 +13,6 @@ class ParserYkdl : public ParserBase
 public:
     explicit ParserYkdl(QObject *parent = 0);
     ~ParserYkdl();
-    static bool isSupported(const QString &host);
 
 protected:
     void runParser(const QString &url);
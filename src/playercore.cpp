@@ -5,13 +5,18 @@
 #include "settings_network.h"
 #include "settings_video.h"
 #include "accessmanager.h"
+#include "ratelimiter.h"
+#include "watchhistory.h"
+#include "hwdecprobe.h"
+#include "mediaindexer.h"
 #include <stdio.h>
+#ifndef Q_OS_WIN
+#include <sys/resource.h>
+#endif
 #include <mpv/client.h>
 #include <QCoreApplication>
 #include <QDir>
 #include <QEvent>
-#include <QHash>
-#include <QMessageBox>
 #include <QOpenGLContext>
 
 // wayland fix
@@ -63,8 +68,6 @@ static void *get_proc_address(void *, const char *name)
 
 PlayerCore *player_core = nullptr;
 
-static QHash<QString,int64_t> unfinished_time;
-
 PlayerCore::PlayerCore(QWidget *parent) :
     QOpenGLWidget(parent)
 {
@@ -92,31 +95,31 @@ PlayerCore::PlayerCore(QWidget *parent) :
 
     // set hardware decoding
 #if defined(Q_OS_LINUX)
+    QByteArray interop;
     if (Settings::hwdec == "auto")
-    {
-        mpv_set_option_string(mpv, "hwdec-preload", "auto");
-        mpv_set_option_string(mpv, "opengl-hwdec-interop", "auto");
-    }
+        interop = "auto";
     else if (Settings::hwdec == "vaapi")
-    {
-        mpv_set_option_string(mpv, "hwdec-preload", "vaapi-egl");
-        mpv_set_option_string(mpv, "opengl-hwdec-interop", "vaapi-egl");
-    }
+        interop = "vaapi-egl";
     else
+        interop = "vdpau-glx";
+    if (HwdecProbe::hasGpu())
     {
-        mpv_set_option_string(mpv, "hwdec-preload", "vdpau-glx");
-        mpv_set_option_string(mpv, "opengl-hwdec-interop", "vdpau-glx");
+        mpv_set_option_string(mpv, "hwdec-preload", interop.constData());
+        mpv_set_option_string(mpv, "opengl-hwdec-interop", interop.constData());
     }
-    QByteArray hwdec = Settings::hwdec.toUtf8() + (Settings::copyMode ? "-copy" : "");
-    mpv_set_option_string(mpv, "hwdec", hwdec);
 #elif defined(Q_OS_MAC)
     mpv_set_option_string(mpv, "opengl-hwdec-interop", "videotoolbox");
-    mpv_set_option_string(mpv, "hwdec", Settings::copyMode ? "videotoolbox-copy" : "videotoolbox");
 #elif defined(Q_OS_WIN)
     mpv_set_option_string(mpv, "opengl-backend", "angle");
-    mpv_set_option_string(mpv, "hwdec", "d3d11va");
 #endif
 
+    // the decoder is switched per codec after the file is loaded
+    hwdecProbe = new HwdecProbe;
+    hwdecRequested = hwdecProbe->chain().first();
+    mpv_set_option_string(mpv, "hwdec", hwdecRequested.toUtf8().constData());
+    if (Settings::decoderThreads > 0)
+        mpv_set_option_string(mpv, "vd-lavc-threads", QByteArray::number(Settings::decoderThreads).constData());
+
     // listen mpv event
     mpv_observe_property(mpv, 0, "duration",         MPV_FORMAT_DOUBLE);
     mpv_observe_property(mpv, 0, "width",            MPV_FORMAT_INT64);
@@ -126,6 +129,8 @@ PlayerCore::PlayerCore(QWidget *parent) :
     mpv_observe_property(mpv, 0, "core-idle",        MPV_FORMAT_FLAG);
     mpv_observe_property(mpv, 0, "track-list",       MPV_FORMAT_NODE);
     mpv_observe_property(mpv, 0, "sid",              MPV_FORMAT_INT64);
+    mpv_observe_property(mpv, 0, "video-format",     MPV_FORMAT_STRING);
+    mpv_observe_property(mpv, 0, "hwdec-current",    MPV_FORMAT_STRING);
     mpv_set_wakeup_callback(mpv, postEvent, this);
 
     // initialize mpv
@@ -152,25 +157,16 @@ PlayerCore::PlayerCore(QWidget *parent) :
     // set state
     state = STOPPING;
     no_emit_stopped = false;
-    reload_when_idle = false;
     emit_stopped_when_idle = false;
     unseekable_forced = false;
     rendering_paused = false;
+    waiting_for_user = false;
+    in_background = false;
+    lastCpuTime = 0;
+    cpuTimer.start();
 
-    // read unfinished_time
-    QString filename = QDir(getUserPath()).filePath("unfinished.txt");
-    QFile file(filename);
-    if (file.open(QFile::ReadOnly | QFile::Text))
-    {
-        QByteArray data = file.readAll();
-        file.close();
-        if (!data.isEmpty())
-        {
-            QStringList list = QString::fromUtf8(data).split('\n');
-            for (int i = 0; i < list.size(); i += 2)
-                unfinished_time[list[i]] = list[i + 1].toInt();
-        }
-    }
+    // positions of unfinished videos are read lazily when a file is opened
+    watchHistory = new WatchHistory;
     player_core = this;
 }
 
@@ -202,8 +198,12 @@ void PlayerCore::swapped()
 
 void PlayerCore::maybeUpdate()
 {
-    if (window()->isMinimized() || rendering_paused)
+    if (window()->isMinimized() || rendering_paused || in_background)
     {
+        // Nobody sees the frames, so draw them at most 5 times per second
+        if (in_background && backgroundDrawTimer.isValid() && backgroundDrawTimer.elapsed() < 200)
+            return;
+        backgroundDrawTimer.start();
         makeCurrent();
         paintGL();
         context()->swapBuffers(context()->surface());
@@ -229,6 +229,58 @@ void PlayerCore::unpauseRendering()
     rendering_paused = false;
 }
 
+// Disable video output when the window is minimized, audio keeps playing
+void PlayerCore::setBackground(bool background)
+{
+    if (background == in_background)
+        return;
+    in_background = background;
+    reportCpuUsage(background ? "foreground" : "background");
+
+    if (background)
+    {
+        if (state == STOPPING)
+            return;
+        char *vid = mpv_get_property_string(mpv, "vid");
+        savedVid = vid ? vid : "";
+        if (vid)
+            mpv_free(vid);
+        if (savedVid.isEmpty() || savedVid == "no") // no video
+        {
+            savedVid.clear();
+            return;
+        }
+        const char *no = "no";
+        handleMpvError(mpv_set_property_async(mpv, 2, "vid", MPV_FORMAT_STRING, &no));
+    }
+    else if (!savedVid.isEmpty())
+    {
+        const char *vid = savedVid.constData();
+        handleMpvError(mpv_set_property_async(mpv, 2, "vid", MPV_FORMAT_STRING, &vid));
+        savedVid.clear();
+        update();
+    }
+}
+
+// Log CPU usage since the last mode switch
+void PlayerCore::reportCpuUsage(const char *mode)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(mode);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return;
+    qint64 cpuTime = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+    qint64 elapsed = cpuTimer.restart();
+    if (elapsed > 0)
+        qDebug("CPU usage in %s mode: %.1f%% (%lld ms in %lld ms)", mode,
+               (cpuTime - lastCpuTime) * 100.0 / elapsed, cpuTime - lastCpuTime, elapsed);
+    lastCpuTime = cpuTime;
+#endif
+}
+
 
 PlayerCore::~PlayerCore()
 {
@@ -244,34 +296,10 @@ PlayerCore::~PlayerCore()
         mpv = nullptr;
     }
 
-    // save unfinished time
-    if (!unfinished_time.isEmpty() && Settings::rememberUnfinished)
-    {
-        QByteArray data;
-        QHash<QString, int64_t>::const_iterator i = unfinished_time.constBegin();
-        while (i != unfinished_time.constEnd())
-        {
-            QString name = i.key();
-            if (!name.startsWith("http://"))
-                data += name.toUtf8() + '\n' + QByteArray::number((int) i.value()) + '\n';
-            i++;
-        }
-        data.chop(1); // Remove last '\n'
-        if (data.isEmpty())
-            return;
-        QString filename = QDir(getUserPath()).filePath("unfinished.txt");
-        QFile file(filename);
-        if (!file.open(QFile::WriteOnly | QFile::Text))
-            return;
-        file.write(data);
-        file.close();
-    }
-    else
-    {
-        QDir dir(getUserPath());
-        if (dir.exists("unfinished.txt"))
-            dir.remove("unfinished.txt");
-    }
+    if (!Settings::rememberUnfinished)
+        watchHistory->clear();
+    delete watchHistory;
+    delete hwdecProbe;
 }
 
 
@@ -295,6 +323,8 @@ bool PlayerCore::event(QEvent *e)
         {
         case MPV_EVENT_START_FILE:
             videoWidth = videoHeight = 0;
+            videoCodec.clear();
+            hwdecCurrent.clear();
             time = 0;
             emit timeChanged(time);
             break;
@@ -317,17 +347,16 @@ bool PlayerCore::event(QEvent *e)
         case MPV_EVENT_END_FILE:
         {
             mpv_event_end_file *ef = static_cast<mpv_event_end_file*>(event->data);
+            rate_limiter->setPlaybackStarving(false);
             if (ef->error == MPV_ERROR_LOADING_FAILED)
             {
-                reload_when_idle = (bool) QMessageBox::question(this, "MPV Error",
-                                      tr("Fails to load: ") + file,
-                                      tr("Skip"),
-                                      tr("Try again"));
-                if (reload_when_idle)
-                {
-                    state = STOPPING;
-                    break;
-                }
+                // Let user choose skip or retry, without blocking the event loop
+                countError();
+                state = STOPPING;
+                no_emit_stopped = false;
+                waiting_for_user = true;
+                emit loadingFailed(file);
+                break;
             }
             else
                 handleMpvError(ef->error);
@@ -336,19 +365,14 @@ bool PlayerCore::event(QEvent *e)
             else
             {
                 if (time > length - 5)
-                    unfinished_time.remove(file);
+                    watchHistory->remove(file);
                 state = STOPPING;
                 emit_stopped_when_idle = true;
             }
             break;
         }
         case MPV_EVENT_IDLE:
-            if (reload_when_idle)
-            {
-                reload_when_idle = false;
-                openFile(file, danmaku);
-            }
-            else if (emit_stopped_when_idle)
+            if (emit_stopped_when_idle)
             {
                 emit_stopped_when_idle = false;
                 emit stopped();
@@ -380,8 +404,12 @@ bool PlayerCore::event(QEvent *e)
             {
                 length = *(double*) prop->data;
                 emit lengthChanged(length);
-                if (unfinished_time.contains(file) && !unseekable_forced)
-                    setProgress(unfinished_time[file]);
+                if (Settings::rememberUnfinished && !unseekable_forced)
+                {
+                    int64_t pos = watchHistory->position(file);
+                    if (pos > 0)
+                        setProgress(pos);
+                }
             }
             else if (propName == "width")
             {
@@ -409,10 +437,13 @@ bool PlayerCore::event(QEvent *e)
             {
                 if (prop->format == MPV_FORMAT_FLAG)
                 {
-                    if ((bool)*(unsigned*)prop->data && state != STOPPING)
+                    bool starving = (bool)*(unsigned*)prop->data && state != STOPPING;
+                    if (starving)
                         showText("Network is slow...");
                     else
                         showText("");
+                    // give bandwidth to playback, except for files served from downloads
+                    rate_limiter->setPlaybackStarving(starving && !file.startsWith("http://127.0.0.1"));
                 }
             }
             else if (propName == "core-idle")
@@ -425,6 +456,16 @@ bool PlayerCore::event(QEvent *e)
                         showText("");
                 }
             }
+            else if (propName == "video-format")
+            {
+                videoCodec = QString::fromUtf8(*(char**) prop->data);
+                checkHwdec();
+            }
+            else if (propName == "hwdec-current") // decoder actually in use
+            {
+                hwdecCurrent = QString::fromUtf8(*(char**) prop->data);
+                checkHwdec();
+            }
             else if (propName == "sid") // set danmaku's delay
             {
                 int sid = *(int64_t *) prop->data;
@@ -487,6 +528,18 @@ bool PlayerCore::event(QEvent *e)
     return true;
 }
 
+// track names as listed by the track-list handler, the index is mpv's track id
+static QStringList trackNames(const QStringList &titles)
+{
+    QStringList list;
+    if (titles.isEmpty())
+        return list;
+    list << "#0";
+    for (int i = 0; i < titles.size(); i++)
+        list << (titles[i].isEmpty() ? '#' + QString::number(i + 1) : titles[i]);
+    return list;
+}
+
 // open file
 void PlayerCore::openFile(const QString &file, const QString &danmaku, const QString &audioTrack)
 {
@@ -494,14 +547,16 @@ void PlayerCore::openFile(const QString &file, const QString &danmaku, const QSt
     {
         no_emit_stopped = true;
         if (time <= length - 5 && Settings::rememberUnfinished)
-            unfinished_time[this->file] = time;
+            watchHistory->save(this->file, time);
         else if (time > length - 5)
-            unfinished_time.remove(file);
+            watchHistory->remove(this->file);
     }
 
+    waiting_for_user = false;
     this->file = file;
     this->danmaku = danmaku;
     this->audioTrack = audioTrack;
+    danmakuLoader->cancel(); // the danmaku of the previous video may be still converting
 
     if (danmaku.isEmpty() && !file.startsWith("http://") && !file.startsWith("https://"))
     {
@@ -522,6 +577,20 @@ void PlayerCore::openFile(const QString &file, const QString &danmaku, const QSt
     else
         danmakuDelay = 0;
 
+    // embedded tracks of indexed local files are known before mpv reports the track list
+    MediaInfo info;
+    if (media_indexer->lookup(file, &info))
+    {
+        audioTracksList = trackNames(info.audioTracks);
+        subtitleList = trackNames(info.subtitleTracks);
+    }
+    else
+    {
+        audioTracksList.clear();
+        subtitleList.clear();
+        media_indexer->request(file, true);
+    }
+
     // set network parameters
     if (file.startsWith("http:") || file.startsWith("https:"))
     {
@@ -559,6 +628,18 @@ void PlayerCore::openFile(const QString &file, const QString &danmaku, const QSt
         unseekable_forced = false;
     }
 
+    // a new file is opened in background, restore video output when the window becomes visible
+    if (in_background)
+    {
+        handleMpvError(mpv_set_option_string(mpv, "vid", "no"));
+        savedVid = "auto";
+    }
+    else if (savedVid == "auto")
+    {
+        handleMpvError(mpv_set_option_string(mpv, "vid", "auto"));
+        savedVid.clear();
+    }
+
     speed = 1.0;
     danmaku_visible = true;
     subDelay = audioDelay = 0;
@@ -593,7 +674,7 @@ void PlayerCore::stop()
     const char *args[] = {"stop", nullptr};
     handleMpvError(mpv_command_async(mpv, 0, args));
     if (time < length - 2 && Settings::rememberUnfinished)
-        unfinished_time[file] = time;
+        watchHistory->save(file, time);
 }
 
 void PlayerCore::setVolume(int volume)
@@ -830,12 +911,85 @@ void PlayerCore::setRatio_16_10()
 }
 
 // handle error
+// Errors are queued and shown after the mpv events are drained, so no nested event loop is run here
 void PlayerCore::handleMpvError(int code)
 {
     if(code >= 0)
         return;
-    QMessageBox::warning(this, "MPV Error", "Error while playing file:\n" + file +
-                         "\n\nMPV Error: " + mpv_error_string(code));
+    countError();
+    QString msg = QString("MPV Error: ") + mpv_error_string(code);
+    if (pendingErrors.contains(msg))
+        return;
+    pendingErrors << msg;
+    if (pendingErrors.size() == 1)
+        QMetaObject::invokeMethod(this, "flushErrors", Qt::QueuedConnection);
+}
+
+void PlayerCore::flushErrors()
+{
+    foreach (QString msg, pendingErrors)
+    {
+        qDebug("%s (file: %s)", msg.toUtf8().constData(), file.toUtf8().constData());
+        showText(msg.toUtf8());
+        emit errorOccurred(msg);
+    }
+    pendingErrors.clear();
+}
+
+// Count errors per host so that unreliable sources can be identified
+void PlayerCore::countError()
+{
+    QString source = (file.startsWith("http://") || file.startsWith("https://")) ? QUrl(file).host() : "local";
+    errorCounts[source]++;
+}
+
+// skip or retry after the file fails to load
+void PlayerCore::retry()
+{
+    if (!waiting_for_user)
+        return;
+    waiting_for_user = false;
+    openFile(file, danmaku, audioTrack);
+}
+
+void PlayerCore::skip()
+{
+    if (!waiting_for_user)
+        return;
+    waiting_for_user = false;
+    emit stopped();
+}
+
+// Check whether the requested hardware decoder works with the codec,
+// switch to the next decoder in the chain if not
+void PlayerCore::checkHwdec()
+{
+    if (videoCodec.isEmpty())
+        return;
+    QString preferred = hwdecProbe->preferred(videoCodec);
+    if (preferred != hwdecRequested) // known to fail, or a better decoder is not tried yet
+    {
+        setHwdec(preferred);
+        return;
+    }
+    if (hwdecCurrent.isEmpty() || hwdecRequested == "no")
+        return;
+
+    bool ok = (hwdecCurrent != "no");
+    hwdecProbe->record(videoCodec, hwdecRequested, ok);
+    if (ok)
+        qDebug("Decoder in use: %s (%s)", hwdecCurrent.toUtf8().constData(), videoCodec.toUtf8().constData());
+    else
+        setHwdec(hwdecProbe->preferred(videoCodec));
+}
+
+void PlayerCore::setHwdec(const QString &hwdec)
+{
+    hwdecRequested = hwdec;
+    hwdecCurrent.clear();
+    QByteArray tmp = hwdec.toUtf8();
+    const char *str = tmp.constData();
+    handleMpvError(mpv_set_property_async(mpv, 2, "hwdec", MPV_FORMAT_STRING, &str));
 }
 
 // show text
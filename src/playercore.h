@@ -1,8 +1,12 @@
 #ifndef MPLAYER_H
 #define MPLAYER_H
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QOpenGLWidget>
 class DanmakuLoader;
+class HwdecProbe;
+class WatchHistory;
 #include <mpv/client.h>
 #include <mpv/opengl_cb.h>
 
@@ -19,6 +23,8 @@ signals:
     void timeChanged(int pos);
     void lengthChanged(int len);
     void sizeChanged(const QSize &size);
+    void errorOccurred(const QString &message);
+    void loadingFailed(const QString &file);
 
 public:
     typedef enum {STOPPING, VIDEO_PLAYING, VIDEO_PAUSING, TV_PLAYING} State;
@@ -32,6 +38,8 @@ public:
     inline double getSubDelay() { return subDelay; }
     inline const QStringList &getSubtitleList() { return subtitleList; }
     inline const QStringList &getAudioTracksList() { return audioTracksList; }
+    inline const QHash<QString,int> &getErrorCounts() { return errorCounts; }
+    inline QString getHwdecCurrent() { return hwdecCurrent; }
 
 public slots:
     void stop(void);
@@ -50,6 +58,7 @@ public slots:
     void showText(const QByteArray &text);
     void pauseRendering(void);
     void unpauseRendering(void);
+    void setBackground(bool background);
     void setAid(int64_t aid);
     void setSid(int64_t sid);
     void setAudioDelay(double v);
@@ -67,6 +76,8 @@ public slots:
     void setSaturation(int64_t v);
     void setGamma(int64_t v);
     void setHue(int64_t v);
+    void retry(void);
+    void skip(void);
 
 protected:
     void initializeGL();
@@ -77,11 +88,22 @@ private:
     mpv_handle *mpv;
     mpv_opengl_cb_context *mpv_gl;
     DanmakuLoader *danmakuLoader;
+    WatchHistory *watchHistory;
+    HwdecProbe *hwdecProbe;
     QString file;
     QString audioTrack;
     QString danmaku;
+    QString videoCodec;
+    QString hwdecRequested;
+    QString hwdecCurrent;
+    QByteArray savedVid;
+    QElapsedTimer backgroundDrawTimer;
+    QElapsedTimer cpuTimer;
+    qint64 lastCpuTime;
     QStringList audioTracksList;
     QStringList subtitleList;
+    QStringList pendingErrors;
+    QHash<QString,int> errorCounts;
     int64_t length;
     int64_t time;
     int64_t videoWidth;
@@ -91,19 +113,25 @@ private:
     double danmakuDelay;
     double subDelay;
     bool no_emit_stopped;
-    bool reload_when_idle;
     bool emit_stopped_when_idle;
     bool danmaku_visible;
     bool unseekable_forced;
     bool rendering_paused;
+    bool waiting_for_user;
+    bool in_background;
 
     void loadDanmaku(void);
     void handleMpvError(int code);
+    void countError(void);
+    void checkHwdec(void);
+    void setHwdec(const QString &hwdec);
+    void reportCpuUsage(const char *mode);
     static void on_update(void *ctx);
 
 private slots:
     void swapped(void);
     void maybeUpdate();
+    void flushErrors(void);
 };
 
 extern PlayerCore *player_core;
@@ -11,6 +11,7 @@
 #include "settings_audio.h"
 #include "settingsdialog.h"
 #include "skin.h"
+#include "thumbnailer.h"
 #include "utils.h"
 #include <QDesktopServices>
 #include <QDesktopWidget>
@@ -18,10 +19,13 @@
 #include <QFileInfo>
 #include <QGridLayout>
 #include <QInputDialog>
+#include <QLabel>
 #include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QPainter>
 #include <QResizeEvent>
+#include <QStyle>
 #include <QTimer>
 
 PlayerView::PlayerView(QWidget *parent) :
@@ -159,13 +163,40 @@ PlayerView::PlayerView(QWidget *parent) :
     menu->addAction(tr("Upgrade parsers"), upgradeParsers);
     menu->addAction(tr("About"), aboutDialog, &AboutDialog::exec);
 
+    // create thumbnailer, which shows previews on the time slider
+    thumbnailer = new Thumbnailer(this);
+    previewLabel = new QLabel(this);
+    previewLabel->setStyleSheet("QLabel { border: 1px solid rgba(255, 255, 255, 180); }");
+    previewLabel->hide();
+    ui->timeSlider->setMouseTracking(true);
+    ui->timeSlider->installEventFilter(this);
+
     // create cutterbar
-    cutterBar = new CutterBar(this);
+    cutterBar = new CutterBar(thumbnailer, this);
     cutterBar->setWindowFlags(cutterBar->windowFlags() | Qt::Popup);
 
+    // create error toast, which shows errors without blocking the player
+    errorToast = new QWidget(this);
+    errorToast->setObjectName("errorToast");
+    errorToast->setStyleSheet("QWidget#errorToast { background: rgba(50, 50, 50, 230); border-radius: 8px; }"
+                              "QLabel { color: white; }");
+    errorLabel = new QLabel;
+    errorLabel->setWordWrap(true);
+    retryButton = new QPushButton(tr("Try again"));
+    skipButton = new QPushButton(tr("Skip"));
+    QGridLayout *toastLayout = new QGridLayout(errorToast);
+    toastLayout->addWidget(errorLabel, 0, 0, 1, 3);
+    toastLayout->addWidget(retryButton, 1, 1, 1, 1);
+    toastLayout->addWidget(skipButton, 1, 2, 1, 1);
+    toastLayout->setColumnStretch(0, 1);
+    errorToast->setFixedWidth(400);
+    errorToast->hide();
+
     // create timer
     hideTimer = new QTimer(this);
     hideTimer->setSingleShot(true);
+    toastTimer = new QTimer(this);
+    toastTimer->setSingleShot(true);
     setMouseTracking(true);
 
     connect(core, &PlayerCore::lengthChanged, this, &PlayerView::onLengthChanged);
@@ -176,6 +207,12 @@ PlayerView::PlayerView(QWidget *parent) :
     connect(core, &PlayerCore::paused, ui->playButton, &QPushButton::show);
     connect(core, &PlayerCore::paused, ui->pauseButton, &QPushButton::hide);
     connect(core, &PlayerCore::stopped, this, &PlayerView::onStopped);
+    connect(core, &PlayerCore::errorOccurred, this, &PlayerView::showError);
+    connect(core, &PlayerCore::loadingFailed, this, &PlayerView::showLoadingFailed);
+    connect(core, &PlayerCore::played, errorToast, &QWidget::hide);
+    connect(toastTimer, &QTimer::timeout, errorToast, &QWidget::hide);
+    connect(retryButton, &QPushButton::clicked, this, &PlayerView::onRetryButton);
+    connect(skipButton, &QPushButton::clicked, this, &PlayerView::onSkipButton);
     connect(downloader, SIGNAL(newFile(QString,QString)), playlist, SLOT(addFile(QString,QString)));
     connect(downloader, SIGNAL(newPlay(QString,QString)), playlist, SLOT(addFileAndPlay(QString,QString)));
     connect(playlist, &Playlist::fileSelected, core, &PlayerCore::openFile);
@@ -312,6 +349,10 @@ void PlayerView::resizeEvent(QResizeEvent *e)
     ui->equalizerWidget->move(e_x, e_y);
     ui->equalizerWidget->raise();
 
+    // move error toast
+    errorToast->move((e->size().width() - errorToast->width()) / 2, 40);
+    errorToast->raise();
+
     // raise borders and titlebar
     leftBorder->raise();
     rightBorder->raise();
@@ -470,6 +511,7 @@ void PlayerView::hideElements()
     {
         // mouse is not in controller and equalizer is hidden
         ui->controllerWidget->hide();
+        previewLabel->hide();
         setCursor(QCursor(Qt::BlankCursor));
     }
 }
@@ -484,6 +526,7 @@ void PlayerView::onLengthChanged(int len)
         ui->timeSlider->setMaximum(len);
         ui->durationLabel->setText(secToTime(len));
     }
+    thumbnailer->load(core->currentFile(), len);
     activateWindow();
     raise();
 }
@@ -508,18 +551,74 @@ void PlayerView::onTimeSliderValueChanged(int time)
     if (core->state == PlayerCore::STOPPING)
         return;
     if (ui->timeSlider->isSliderDown()) // move by mouse
+    {
         ui->timeLabel->setText(secToTime(time));
+        showPreview(time);
+    }
     else // move by keyboard
         core->setProgress(time);
 }
 
 void PlayerView::onTimeSliderReleased()
 {
+    previewLabel->hide();
     if (core->state == PlayerCore::STOPPING)
         return;
     core->setProgress(ui->timeSlider->value());
 }
 
+// preview from the thumbnail sprite, the player is not touched
+bool PlayerView::eventFilter(QObject *obj, QEvent *e)
+{
+    if (obj == ui->timeSlider)
+    {
+        if (e->type() == QEvent::MouseMove && !ui->timeSlider->isSliderDown())
+        {
+            QSlider *slider = ui->timeSlider;
+            int x = static_cast<QMouseEvent*>(e)->pos().x();
+            showPreview(QStyle::sliderValueFromPosition(slider->minimum(), slider->maximum(), x, slider->width()));
+        }
+        else if (e->type() == QEvent::Leave)
+            previewLabel->hide();
+    }
+    return QWidget::eventFilter(obj, e);
+}
+
+void PlayerView::showPreview(int pos)
+{
+    QImage image;
+    if (core->state != PlayerCore::STOPPING && core->state != PlayerCore::TV_PLAYING &&
+            thumbnailer->currentFile() == core->currentFile())
+        image = thumbnailer->thumbnail(pos);
+    if (image.isNull())
+    {
+        previewLabel->hide();
+        return;
+    }
+
+    // draw time on the bottom
+    QPixmap pixmap = QPixmap::fromImage(image);
+    QPainter painter(&pixmap);
+    QString text = secToTime(pos);
+    QRect rect = painter.fontMetrics().boundingRect(text).adjusted(-4, -1, 4, 1);
+    rect.moveCenter(QPoint(pixmap.width() / 2, pixmap.height() - rect.height() / 2 - 2));
+    painter.fillRect(rect, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(rect, Qt::AlignCenter, text);
+    painter.end();
+    previewLabel->setPixmap(pixmap);
+    previewLabel->adjustSize();
+
+    // above the slider handle
+    QSlider *slider = ui->timeSlider;
+    int x = QStyle::sliderPositionFromValue(slider->minimum(), slider->maximum(), pos, slider->width());
+    QPoint p = slider->mapTo(this, QPoint(x, 0));
+    x = qBound(0, p.x() - previewLabel->width() / 2, width() - previewLabel->width());
+    previewLabel->move(x, p.y() - previewLabel->height() - 4);
+    previewLabel->show();
+    previewLabel->raise();
+}
+
 void PlayerView::onSizeChanged(const QSize &sz)
 {
     if (isFullScreen())
@@ -592,20 +691,22 @@ void PlayerView::setFullScreen()
     }
 }
 
-#ifdef Q_OS_MAC
 void PlayerView::changeEvent(QEvent *e)
 {
     if (e->type() == QEvent::WindowStateChange)
     {
         QWindowStateChangeEvent *ce = static_cast<QWindowStateChangeEvent*>(e);
+        // stop rendering video while minimized
+        core->setBackground(isMinimized());
+#ifdef Q_OS_MAC
         if ((ce->oldState() & Qt::WindowFullScreen) && !isFullScreen())
             setWindowFlag(Qt::FramelessWindowHint, true);
+#endif
         ce->accept();
         return;
     }
     QWidget::changeEvent(e);
 }
-#endif
 
 
 // add & select subtitle and set subtitle delay
@@ -670,6 +771,46 @@ void PlayerView::onMaxButton()
         showMaximized();
 }
 
+// show errors in toast
+void PlayerView::showError(const QString &message)
+{
+    // Do not hide the question of a file that fails to load
+    if (errorToast->isVisible() && retryButton->isVisible())
+        return;
+    errorLabel->setText(message);
+    retryButton->hide();
+    skipButton->hide();
+    errorToast->adjustSize();
+    errorToast->move((width() - errorToast->width()) / 2, 40);
+    errorToast->show();
+    errorToast->raise();
+    toastTimer->start(5000);
+}
+
+void PlayerView::showLoadingFailed(const QString &file)
+{
+    toastTimer->stop();
+    errorLabel->setText(tr("Fails to load: ") + file);
+    retryButton->show();
+    skipButton->show();
+    errorToast->adjustSize();
+    errorToast->move((width() - errorToast->width()) / 2, 40);
+    errorToast->show();
+    errorToast->raise();
+}
+
+void PlayerView::onRetryButton()
+{
+    errorToast->hide();
+    core->retry();
+}
+
+void PlayerView::onSkipButton()
+{
+    errorToast->hide();
+    core->skip();
+}
+
 //open extension page
 void PlayerView::openExtPage()
 {
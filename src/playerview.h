@@ -12,12 +12,15 @@ class Border;
 class CutterBar;
 class Playlist;
 class PlayerCore;
+class QLabel;
 class QMenu;
+class QPushButton;
 class QSlider;
 class QTimer;
 class ResLibrary;
 class SelectionDialog;
 class SettingsDialog;
+class Thumbnailer;
 
 class PlayerView : public QWidget
 {
@@ -28,11 +31,10 @@ public:
     ~PlayerView();
 
 protected:
-#ifdef Q_OS_MAC
     void changeEvent(QEvent *e);
-#endif
     void contextMenuEvent(QContextMenuEvent *e);
     void closeEvent(QCloseEvent *e);
+    bool eventFilter(QObject *obj, QEvent *e);
     void dragEnterEvent(QDragEnterEvent *e);
     void dropEvent(QDropEvent *e);
     void keyPressEvent(QKeyEvent *e);
@@ -49,6 +51,7 @@ private slots:
     void onTimeSliderPressed(void);
     void onTimeSliderValueChanged(int time);
     void onTimeSliderReleased(void);
+    void showPreview(int pos);
     void onSizeChanged(const QSize &sz);
     void onMaxButton(void);
     void onStopButton(void);
@@ -66,6 +69,10 @@ private slots:
     void showVolumeSlider(void);
     void hideElements(void);
     void openExtPage(void);
+    void showError(const QString &message);
+    void showLoadingFailed(const QString &file);
+    void onRetryButton(void);
+    void onSkipButton(void);
 
 private:
     Ui::PlayerView *ui;
@@ -81,10 +88,17 @@ private:
     QMenu *menu;
     QSlider *volumeSlider;
     QTimer *hideTimer;
+    QTimer *toastTimer;
+    QWidget *errorToast;
+    QLabel *errorLabel;
+    QLabel *previewLabel;
+    QPushButton *retryButton;
+    QPushButton *skipButton;
     QPoint dPos;
     ResLibrary *reslibrary;
     SelectionDialog *selectionDialog;
     SettingsDialog *settingsDialog;
+    Thumbnailer *thumbnailer;
     bool quit_requested;
     bool no_play_next;
     bool ctrl_pressed;
@@ -4,18 +4,12 @@
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QMenu>
-#include "utils.h"
+#include <QUrl>
+#include "mediaindexer.h"
 #include "parserbase.h"
-
-class ItemForPlaylist : public QListWidgetItem
-{
-public:
-    QString uri;
-    QString danmaku;
-    QString audioTrack;
-    ItemForPlaylist(const QString &name, const QString &uri, const QString &danmaku, const QString &audioTrack) :
-        QListWidgetItem(name), uri(uri), danmaku(danmaku), audioTrack(audioTrack) {}
-};
+#include "playlistloader.h"
+#include "playlistmodel.h"
+#include "utils.h"
 
 Playlist *playlist = nullptr;
 
@@ -25,6 +19,28 @@ Playlist::Playlist(QWidget *parent) :
 {
     printf("Initialize playlist...\n");
     ui->setupUi(this);
+    model = new PlaylistModel(this);
+    ui->listView->setModel(model);
+    loader = new PlaylistLoader(model, this);
+    connect(loader, &PlaylistLoader::listFound, this, &Playlist::onListFound);
+    connect(loader, &PlaylistLoader::streamFound, this, [=](const QString &url) {
+        if (url.startsWith("http://") || url.startsWith("https://"))
+            parseUrlWithPrompt(url);
+        else
+            addFileAndPlay(QUrl(url).fileName(), url);
+    });
+
+    // durations of local files are filled by the media indexer
+    connect(model, &PlaylistModel::rowsInserted, this, &Playlist::onRowsInserted);
+    connect(model, &PlaylistModel::rowsRemoved, this, &Playlist::updateTotal);
+    connect(model, &PlaylistModel::modelReset, this, &Playlist::updateTotal);
+    connect(model, &PlaylistModel::dataChanged, this, &Playlist::updateTotal);
+    connect(media_indexer, &MediaIndexer::indexed, this, [=](const QString &file, const MediaInfo &info) {
+        if (info.duration > 0)
+            model->setDuration(file, info.duration);
+    });
+    ui->totalLabel->hide();
+    last_index = -1;
     connect(ui->delButton, SIGNAL(clicked()), this, SLOT(onDelButton()));
     connect(ui->clearButton, SIGNAL(clicked()), this, SLOT(clearList()));
 
@@ -33,7 +49,7 @@ Playlist::Playlist(QWidget *parent) :
     menu->addAction(tr("Add url"), this, SLOT(onNetItem()), QKeySequence("Ctrl+U"));
     menu->addAction(tr("Add playlist"), this, SLOT(onListItem()));
     connect(ui->addButton, SIGNAL(clicked()), this, SLOT(showMenu()));
-    connect(ui->listWidget, SIGNAL(itemDoubleClicked(QListWidgetItem*)), this, SLOT(selectFile(QListWidgetItem*)));
+    connect(ui->listView, &QListView::doubleClicked, this, &Playlist::selectFile);
 
     playlist = this;
 }
@@ -53,15 +69,21 @@ void Playlist::showMenu()
 // Delete
 void Playlist::onDelButton()
 {
-    QListWidgetItem* item = ui->listWidget->currentItem();
-    if (item == 0)
+    int row = ui->listView->currentIndex().row();
+    if (row == -1)
         return;
-    delete item;
+    model->removeRows(row, 1);
+    // keep pointing to the playing item
+    if (row < last_index)
+        last_index--;
 }
 
 void Playlist::clearList()
 {
-    ui->listWidget->clear();
+    loader->abort();
+    media_indexer->cancelRequests();
+    model->clear();
+    last_index = -1;
 }
 
 // Add
@@ -90,13 +112,13 @@ void Playlist::onAddItem()
 
 void Playlist::addFile(const QString& name, const QString& file, const QString &danmaku, const QString &audioTrack)
 {
-    ui->listWidget->addItem(new ItemForPlaylist(name, file, danmaku, audioTrack));
+    model->append(name, file, danmaku, audioTrack);
 }
 
 void Playlist::addFileAndPlay(const QString& name, const QString& file, const QString &danmaku, const QString &audioTrack)
 {
-    last_index = ui->listWidget->count();
-    ui->listWidget->addItem(new ItemForPlaylist(name, file, danmaku, audioTrack));
+    last_index = model->rowCount();
+    model->append(name, file, danmaku, audioTrack);
     emit fileSelected(file, danmaku, audioTrack);
 }
 
@@ -110,36 +132,18 @@ void Playlist::onListItem()
     emit needPause(false);
 }
 
+// Read .m3u, .m3u8 or .xspf playlist from a file or url
+// The list is cleared in onListFound(), a HLS stream keeps the current list
 void Playlist::addList(const QString& filename)
 {
-    QFile file(filename);
-    QString line;
-    if (!file.open(QFile::ReadOnly | QFile::Text))
-        return;
-    clearList();
-
-    if (filename.endsWith(".xspf")) //Read .xspf playlist
-    {
-        QStringList list;
-        QByteArray page = file.readAll();
-        file.close();
-        readXspf(page, list);
-        while (!list.isEmpty())
-        {
-            QString name = list.takeFirst();
-            QString file = list.takeFirst();
-            addFile(name, file);
-        }
-        return;
-    }
+    loader->load(filename);
+}
 
-    while (!file.atEnd()) //read .m3u playlist
-    {
-        line = file.readLine().split('#')[0].simplified();
-        if (!line.isEmpty())
-            addFile(line.section('/', -1), line);
-    }
-    file.close();
+void Playlist::onListFound()
+{
+    media_indexer->cancelRequests();
+    model->clear();
+    last_index = -1;
 }
 
 //play Internet resources
@@ -153,28 +157,59 @@ void Playlist::onNetItem()
 }
 
 void Playlist::addUrl(const QString &url)
+{
+    QString path = QUrl(url).path();
+    if (path.endsWith(".m3u") || path.endsWith(".m3u8") || path.endsWith(".xspf"))
+    {
+        addList(url);
+        return;
+    }
+    parseUrlWithPrompt(url);
+}
+
+void Playlist::parseUrlWithPrompt(const QString &url)
 {
     bool down = (QMessageBox::question(this, "Question", tr("Download?"),
                               QMessageBox::Yes, QMessageBox::No) == QMessageBox::Yes);
     parseUrl(url, down);
 }
 
+void Playlist::onRowsInserted(const QModelIndex &, int first, int last)
+{
+    for (int i = first; i <= last; i++)
+        media_indexer->request(model->uri(i));
+    updateTotal();
+}
+
+void Playlist::updateTotal()
+{
+    qint64 total = model->totalDuration();
+    if (total == 0)
+    {
+        ui->totalLabel->hide();
+        return;
+    }
+    QString text = tr("Total: %1").arg(secToTime(total));
+    if (model->unknownDurations())
+        text += '+';
+    ui->totalLabel->setText(text);
+    ui->totalLabel->show();
+}
+
 //called when a file is selected
-void Playlist::selectFile(QListWidgetItem *item)
+void Playlist::selectFile(const QModelIndex &index)
 {
-    last_index = ui->listWidget->row(item);
-    ItemForPlaylist *i = static_cast<ItemForPlaylist*>(item);
-    emit fileSelected(i->uri, i->danmaku, i->audioTrack);
+    last_index = index.row();
+    emit fileSelected(model->uri(last_index), model->danmaku(last_index), model->audioTrack(last_index));
 }
 
 //play the next video
 void Playlist::playNext()
 {
     last_index++;
-    if (last_index < ui->listWidget->count())
+    if (last_index < model->rowCount())
     {
-        ui->listWidget->setCurrentRow(last_index);
-        ItemForPlaylist *item = static_cast<ItemForPlaylist*>(ui->listWidget->item(last_index));
-        emit fileSelected(item->uri, item->danmaku, item->audioTrack);
+        ui->listView->setCurrentIndex(model->index(last_index));
+        emit fileSelected(model->uri(last_index), model->danmaku(last_index), model->audioTrack(last_index));
     }
 }
@@ -2,8 +2,10 @@
 #define PLAYLIST_H
 
 #include <QWidget>
-class QListWidgetItem;
 class QMenu;
+class QModelIndex;
+class PlaylistLoader;
+class PlaylistModel;
 
 namespace Ui {
 class Playlist;
@@ -35,14 +37,21 @@ signals:
     void needPause(bool);
 
 private slots:
-    void selectFile(QListWidgetItem* item);
+    void selectFile(const QModelIndex &index);
     void clearList(void);
     void showMenu(void);
+    void onRowsInserted(const QModelIndex &parent, int first, int last);
+    void updateTotal(void);
+    void onListFound(void);
     
 private:
     Ui::Playlist *ui;
     QMenu *menu;
+    PlaylistModel *model;
+    PlaylistLoader *loader;
     int last_index;
+
+    void parseUrlWithPrompt(const QString &url);
 };
 extern Playlist *playlist;
 
@@ -0,0 +1,269 @@
+#include "playlistloader.h"
+#include "accessmanager.h"
+#include "playlistmodel.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <ctype.h>
+
+#define CHUNK_SIZE 65536
+#define BATCH_SIZE 500
+
+PlaylistLoader::PlaylistLoader(PlaylistModel *model, QObject *parent) :
+    QObject(parent), model(model)
+{
+    reply = nullptr;
+    format = UNKNOWN;
+    count = 0;
+    duration = -1;
+    stopped = true;
+    in_track = false;
+}
+
+void PlaylistLoader::load(const QString &source)
+{
+    abort();
+    this->source = source;
+    format = UNKNOWN;
+    count = 0;
+    stopped = false;
+    line_buffer.clear();
+    title.clear();
+    duration = -1;
+    xml.clear();
+    text.clear();
+    location.clear();
+    in_track = false;
+
+    // remote playlists are parsed while downloading
+    if (source.startsWith("http://") || source.startsWith("https://"))
+    {
+        base_url = QUrl(source);
+        QNetworkRequest request(base_url);
+        request.setRawHeader("User-Agent", generateUA(base_url));
+        reply = access_manager->get(request);
+        connect(reply, &QNetworkReply::readyRead, this, &PlaylistLoader::onReadyRead);
+        connect(reply, &QNetworkReply::finished, this, &PlaylistLoader::onFinished);
+        return;
+    }
+
+    base_url = QUrl::fromLocalFile(source);
+    QFile file(source);
+    if (!file.open(QFile::ReadOnly))
+    {
+        qDebug("PlaylistLoader: cannot open %s", source.toUtf8().constData());
+        stopped = true;
+        return;
+    }
+    while (!stopped && !file.atEnd())
+        feed(file.read(CHUNK_SIZE));
+    file.close();
+    finish();
+}
+
+void PlaylistLoader::abort()
+{
+    stopped = true;
+    // entries queued so far must not be flushed with the next playlist
+    model->discardPending();
+    if (reply)
+    {
+        QNetworkReply *r = reply;
+        reply = nullptr;
+        r->disconnect(this);
+        r->abort();
+        r->deleteLater();
+    }
+}
+
+void PlaylistLoader::onReadyRead()
+{
+    feed(reply->readAll());
+    // show what has been loaded so far
+    if (!stopped)
+        model->flush();
+}
+
+void PlaylistLoader::onFinished()
+{
+    // feed() may abort the loader, which resets reply
+    QNetworkReply *r = reply;
+    reply = nullptr;
+    if (r->error() != QNetworkReply::NoError)
+        qDebug() << "PlaylistLoader:" << r->errorString();
+    else
+        feed(r->readAll());
+    r->deleteLater();
+    finish();
+}
+
+void PlaylistLoader::feed(const QByteArray &data)
+{
+    if (stopped || data.isEmpty())
+        return;
+    QByteArray chunk = data;
+
+    // detect format from the first bytes
+    if (format == UNKNOWN)
+    {
+        int i = chunk.startsWith("\xef\xbb\xbf") ? 3 : 0;   // skip BOM
+        while (i < chunk.size() && isspace((unsigned char) chunk[i]))
+            i++;
+        if (i == chunk.size())
+            return;
+        format = (chunk[i] == '<' || base_url.path().endsWith(".xspf")) ? XSPF : M3U;
+        chunk = chunk.mid(i);
+    }
+
+    if (format == XSPF)
+    {
+        xml.addData(chunk);
+        parseXspf();
+        return;
+    }
+
+    // m3u, parse complete lines and keep the rest
+    line_buffer += chunk;
+    int start = 0, end;
+    while (!stopped && (end = line_buffer.indexOf('\n', start)) != -1)
+    {
+        parseM3uLine(line_buffer.mid(start, end - start));
+        start = end + 1;
+    }
+    line_buffer.remove(0, start);
+}
+
+void PlaylistLoader::finish()
+{
+    if (!stopped && format == M3U && !line_buffer.isEmpty())
+        parseM3uLine(line_buffer);
+    line_buffer.clear();
+    if (!stopped)
+        model->flush();
+    qDebug("PlaylistLoader: %d entries loaded from %s", count, source.toUtf8().constData());
+    stopped = true;
+}
+
+// #EXTINF:<duration> [attributes],<title>
+// <uri>
+void PlaylistLoader::parseM3uLine(const QByteArray &line)
+{
+    QByteArray l = line.trimmed();
+    if (l.isEmpty())
+        return;
+
+    if (l.startsWith('#'))
+    {
+        if (l.startsWith("#EXTINF:"))
+        {
+            // commas may appear in quoted attributes
+            int i = 8;
+            bool quoted = false;
+            for (; i < l.size(); i++)
+            {
+                if (l[i] == '"')
+                    quoted = !quoted;
+                else if (l[i] == ',' && !quoted)
+                    break;
+            }
+            QByteArray info = l.mid(8, i - 8).trimmed();
+            duration = qRound(info.left(info.indexOf(' ')).toDouble());
+            if (duration <= 0)
+                duration = -1;
+            title = i < l.size() ? QString::fromUtf8(l.mid(i + 1)).trimmed() : QString();
+        }
+        else if (l.startsWith("#EXT-X-"))   // HLS tags, play it as a video
+        {
+            QString url = source;
+            abort();
+            emit streamFound(url);
+        }
+        return;
+    }
+
+    add(title, QString::fromUtf8(l), duration);
+    title.clear();
+    duration = -1;
+}
+
+void PlaylistLoader::parseXspf()
+{
+    while (!stopped && !xml.atEnd())
+    {
+        switch (xml.readNext())
+        {
+        case QXmlStreamReader::StartElement:
+            if (xml.name() == QLatin1String("track"))
+            {
+                in_track = true;
+                title.clear();
+                location.clear();
+                duration = -1;
+            }
+            text.clear();
+            break;
+
+        case QXmlStreamReader::Characters:
+            if (in_track)
+                text += xml.text();
+            break;
+
+        case QXmlStreamReader::EndElement:
+            if (!in_track)
+                break;
+            if (xml.name() == QLatin1String("track"))
+            {
+                in_track = false;
+                if (!location.isEmpty())
+                    add(title, location, duration);
+            }
+            else if (xml.name() == QLatin1String("title"))
+                title = text.trimmed();
+            else if (xml.name() == QLatin1String("location") && location.isEmpty())
+                location = text.trimmed();
+            else if (xml.name() == QLatin1String("duration"))   // in milliseconds
+            {
+                int ms = text.trimmed().toInt();
+                duration = ms > 0 ? (ms + 500) / 1000 : -1;
+            }
+            text.clear();
+            break;
+
+        case QXmlStreamReader::Invalid:
+            // wait for more data if the document is incomplete
+            if (xml.error() != QXmlStreamReader::PrematureEndOfDocumentError)
+            {
+                qDebug() << "PlaylistLoader:" << xml.errorString();
+                model->flush();
+                stopped = true;
+            }
+            return;
+
+        default:
+            break;
+        }
+    }
+}
+
+void PlaylistLoader::add(const QString &name, const QString &uri, int duration)
+{
+    if (count == 0)
+        emit listFound();
+    QString file = uri;
+    if (file.startsWith("file://"))
+        file = QUrl(file).toLocalFile();
+    else if (!file.contains("://"))   // relative to the playlist
+    {
+        if (!base_url.isLocalFile())
+            file = base_url.resolved(QUrl(file)).toString();
+        else if (QDir::isRelativePath(file))
+            file = QDir::cleanPath(QFileInfo(source).absoluteDir().filePath(file));
+    }
+    model->queue(name.isEmpty() ? file.section('/', -1) : name, file, QString(), QString(), duration);
+    count++;
+    if (count % BATCH_SIZE == 0)
+        model->flush();
+}
@@ -0,0 +1,60 @@
+#ifndef PLAYLISTLOADER_H
+#define PLAYLISTLOADER_H
+
+#include <QObject>
+#include <QUrl>
+#include <QXmlStreamReader>
+class QNetworkReply;
+class PlaylistModel;
+
+/* Load .m3u/.m3u8/.xspf playlists from local files or http(s) urls in a single pass.
+ * Data is parsed as it is read, and the entries are added to the model in batches,
+ * keeping the titles and durations given by #EXTINF or by <title> and <duration>.
+ */
+
+class PlaylistLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PlaylistLoader(PlaylistModel *model, QObject *parent = 0);
+    void load(const QString &source);
+    void abort(void);
+
+signals:
+    void listFound(void);                   // emitted before the first entry is added
+    void streamFound(const QString &url);   // the .m3u8 is a HLS stream, not a playlist
+
+private slots:
+    void onReadyRead(void);
+    void onFinished(void);
+
+private:
+    enum Format {UNKNOWN, M3U, XSPF};
+    PlaylistModel *model;
+    QNetworkReply *reply;
+    QString source;
+    QUrl base_url;
+    Format format;
+    int count;
+    bool stopped;
+
+    // m3u
+    QByteArray line_buffer;
+    QString title;
+    int duration;
+
+    // xspf
+    QXmlStreamReader xml;
+    QString element;
+    QString text;
+    QString location;
+    bool in_track;
+
+    void feed(const QByteArray &data);
+    void finish(void);
+    void parseM3uLine(const QByteArray &line);
+    void parseXspf(void);
+    void add(const QString &name, const QString &uri, int duration);
+};
+
+#endif // PLAYLISTLOADER_H
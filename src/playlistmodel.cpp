@@ -0,0 +1,163 @@
+#include "playlistmodel.h"
+#include "utils.h"
+
+PlaylistModel::PlaylistModel(QObject *parent) : QAbstractListModel(parent)
+{
+    strings << QString();
+    string2index[QString()] = 0;
+    total_duration = 0;
+    n_unknown = 0;
+    search_hint = 0;
+}
+
+int PlaylistModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : entries.size();
+}
+
+QVariant PlaylistModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+    const Entry &entry = entries[index.row()];
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return entry.name.isNull() ? entry.uri.section('/', -1) : entry.name;
+    case Qt::ToolTipRole:
+    {
+        QString name = entry.name.isNull() ? entry.uri.section('/', -1) : entry.name;
+        return entry.duration > 0 ? QString("%1 (%2)").arg(name, secToTime(entry.duration)) : name;
+    }
+    case UriRole:
+        return entry.uri;
+    case DanmakuRole:
+        return strings[entry.danmaku];
+    case AudioTrackRole:
+        return strings[entry.audio_track];
+    case DurationRole:
+        return entry.duration;
+    default:
+        return QVariant();
+    }
+}
+
+bool PlaylistModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || row < 0 || count <= 0 || row + count > entries.size())
+        return false;
+    beginRemoveRows(parent, row, row + count - 1);
+    for (int i = row; i < row + count; i++)
+        this->count(entries[i], -1);
+    entries.remove(row, count);
+    endRemoveRows();
+    return true;
+}
+
+PlaylistModel::Entry PlaylistModel::makeEntry(const QString &name, const QString &uri,
+                                              const QString &danmaku, const QString &audioTrack,
+                                              int duration)
+{
+    Entry entry;
+    entry.uri = uri;
+    if (name != uri.section('/', -1))
+        entry.name = name;
+    entry.danmaku = intern(danmaku);
+    entry.audio_track = intern(audioTrack);
+    entry.duration = duration;
+    return entry;
+}
+
+// keep the total duration and the copies of uris up to date
+void PlaylistModel::count(const Entry &entry, int sign)
+{
+    if (entry.duration > 0)
+        total_duration += sign * entry.duration;
+    else
+        n_unknown += sign;
+    int &n = copies[entry.uri];
+    n += sign;
+    if (n <= 0)
+        copies.remove(entry.uri);
+}
+
+int PlaylistModel::intern(const QString &str)
+{
+    if (str.isEmpty())
+        return 0;
+    int i = string2index.value(str, -1);
+    if (i == -1)
+    {
+        i = strings.size();
+        strings << str;
+        string2index[str] = i;
+    }
+    return i;
+}
+
+void PlaylistModel::append(const QString &name, const QString &uri, const QString &danmaku, const QString &audioTrack)
+{
+    beginInsertRows(QModelIndex(), entries.size(), entries.size());
+    entries << makeEntry(name, uri, danmaku, audioTrack);
+    count(entries.last(), 1);
+    endInsertRows();
+}
+
+void PlaylistModel::queue(const QString &name, const QString &uri, const QString &danmaku, const QString &audioTrack,
+                          int duration)
+{
+    pending << makeEntry(name, uri, danmaku, audioTrack, duration);
+}
+
+// insert queued entries in one batch, so views are updated once
+void PlaylistModel::flush()
+{
+    if (pending.isEmpty())
+        return;
+    beginInsertRows(QModelIndex(), entries.size(), entries.size() + pending.size() - 1);
+    for (int i = 0; i < pending.size(); i++)
+        count(pending[i], 1);
+    if (entries.isEmpty())
+        entries.swap(pending);
+    else
+        entries += pending;
+    pending.clear();
+    endInsertRows();
+}
+
+void PlaylistModel::clear()
+{
+    beginResetModel();
+    entries.clear();
+    pending.clear();
+    strings.resize(1);
+    string2index.clear();
+    string2index[QString()] = 0;
+    total_duration = 0;
+    n_unknown = 0;
+    search_hint = 0;
+    copies.clear();
+    endResetModel();
+}
+
+// durations usually come in the order of the list, so search from the last match
+void PlaylistModel::setDuration(const QString &uri, int duration)
+{
+    int n = entries.size();
+    int remaining = copies.value(uri);
+    for (int i = 0; i < n && remaining > 0; i++)
+    {
+        int row = (search_hint + i) % n;
+        Entry &entry = entries[row];
+        if (entry.uri != uri)
+            continue;
+        search_hint = row + 1;
+        remaining--;
+        if (entry.duration == duration)
+            continue;
+        count(entry, -1);
+        entry.duration = duration;
+        count(entry, 1);
+        emit dataChanged(index(row), index(row), QVector<int>() << Qt::ToolTipRole << DurationRole);
+    }
+}
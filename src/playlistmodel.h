@@ -0,0 +1,63 @@
+#ifndef PLAYLISTMODEL_H
+#define PLAYLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QVector>
+
+/* Entries of the playlist, kept in a compact array.
+ * The name is not stored if it is the last part of the uri, and danmaku and audio tracks, which are
+ * usually empty or shared, are interned. Entries added by queue() are inserted at once by flush().
+ */
+
+class PlaylistModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Roles {UriRole = Qt::UserRole, DanmakuRole, AudioTrackRole, DurationRole};
+    explicit PlaylistModel(QObject *parent = nullptr);
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
+
+    void append(const QString &name, const QString &uri,
+                const QString &danmaku = QString(), const QString &audioTrack = QString());
+    void queue(const QString &name, const QString &uri,
+               const QString &danmaku = QString(), const QString &audioTrack = QString(), int duration = -1);
+    void flush(void);
+    inline void discardPending(void) { pending.clear(); }
+    void clear(void);
+    void setDuration(const QString &uri, int duration);
+
+    inline qint64 totalDuration(void) const { return total_duration; }
+    inline int unknownDurations(void) const { return n_unknown; }
+
+    inline QString uri(int row) const { return entries[row].uri; }
+    inline QString danmaku(int row) const { return strings[entries[row].danmaku]; }
+    inline QString audioTrack(int row) const { return strings[entries[row].audio_track]; }
+    inline int duration(int row) const { return entries[row].duration; }
+
+private:
+    struct Entry
+    {
+        QString uri;
+        QString name;       // null if it is the last part of uri
+        int danmaku;        // index in strings
+        int audio_track;
+        int duration;       // in seconds, -1 if unknown
+    };
+    QVector<Entry> entries;
+    QVector<Entry> pending;
+    QVector<QString> strings;   // interned strings, the first is empty
+    QHash<QString, int> string2index;
+    qint64 total_duration;      // sum of known durations
+    int n_unknown;              // entries without duration
+    int search_hint;            // row after the last one found by setDuration()
+    QHash<QString, int> copies; // rows of each uri, so that setDuration() stops after the last one
+    Entry makeEntry(const QString &name, const QString &uri, const QString &danmaku, const QString &audioTrack,
+                    int duration = -1);
+    int intern(const QString &str);
+    void count(const Entry &entry, int sign);
+};
+
+#endif // PLAYLISTMODEL_H
@@ -0,0 +1,75 @@
+#include "postprocessor.h"
+#include "settings_network.h"
+#include "videocombiner.h"
+#include <QStorageInfo>
+#include <QThread>
+
+PostProcessor::PostProcessor(QObject *parent) : QObject(parent)
+{
+}
+
+
+void PostProcessor::add(VideoCombiner *job, int priority)
+{
+    connect(job, SIGNAL(finished(int)), this, SLOT(onJobFinished()));
+    job->priority = priority;
+    // keep the order of jobs with the same priority
+    int i = 0;
+    while (i < queue.size() && queue[i]->priority >= priority)
+        i++;
+    queue.insert(i, job);
+    startNext();
+}
+
+
+void PostProcessor::setPriority(VideoCombiner *job, int priority)
+{
+    if (queue.removeOne(job))
+        add(job, priority);
+}
+
+
+void PostProcessor::cancel(VideoCombiner *job)
+{
+    if (queue.removeOne(job))
+        job->deleteLater();
+    else if (running.contains(job))
+        job->cancel(); // emits finished() later
+}
+
+
+void PostProcessor::startNext()
+{
+    int maxWorkers = Settings::combineWorkers;
+    bool auto_workers = (maxWorkers <= 0);
+    if (auto_workers)
+        maxWorkers = qMax(1, QThread::idealThreadCount() / 2);
+
+    for (int i = 0; i < queue.size() && running.size() < maxWorkers;)
+    {
+        VideoCombiner *job = queue[i];
+        QByteArray device = QStorageInfo(job->directory()).device();
+        // stream copy is limited by disk, running two jobs on one disk only makes seeking
+        if (auto_workers && runningDevices.contains(device))
+        {
+            i++;
+            continue;
+        }
+        queue.removeAt(i);
+        running << job;
+        runningDevices << device;
+        job->run();
+    }
+}
+
+
+void PostProcessor::onJobFinished()
+{
+    VideoCombiner *job = static_cast<VideoCombiner*>(sender());
+    int i = running.indexOf(job);
+    if (i == -1)
+        return;
+    running.removeAt(i);
+    runningDevices.removeAt(i);
+    startNext();
+}
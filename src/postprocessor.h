@@ -0,0 +1,35 @@
+#ifndef POSTPROCESSOR_H
+#define POSTPROCESSOR_H
+
+#include <QObject>
+#include <QList>
+class VideoCombiner;
+
+/* Queue of combining jobs.
+ * Jobs with higher priority start first. The number of running jobs is limited by
+ * Settings::combineWorkers. If it is 0, one job runs on each disk and at most half of the CPUs are used.
+ */
+
+class PostProcessor : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {LOW_PRIORITY = -1, NORMAL_PRIORITY = 0, HIGH_PRIORITY = 1};
+
+    explicit PostProcessor(QObject *parent = nullptr);
+    void add(VideoCombiner *job, int priority = NORMAL_PRIORITY);
+    void setPriority(VideoCombiner *job, int priority);
+    void cancel(VideoCombiner *job);
+    inline bool isQueued(VideoCombiner *job) { return queue.contains(job); }
+
+private:
+    QList<VideoCombiner*> queue;
+    QList<VideoCombiner*> running;
+    QList<QByteArray> runningDevices;
+    void startNext(void);
+
+private slots:
+    void onJobFinished(void);
+};
+
+#endif // POSTPROCESSOR_H
@@ -2,6 +2,7 @@
 #include "accessmanager.h"
 #include "parserwebcatch.h"
 #include "platform/paths.h"
+#include "pythonthread.h"
 #include "reslibrary.h"
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -72,6 +73,7 @@ void GetUrl::onTimeOut()
 
 void GetUrl::onFinished()
 {
+    PyGILLocker locker;
     timer->stop();
     //check redirection
     int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
@@ -99,12 +101,17 @@ void GetUrl::onFinished()
     {
         int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         QString errStr = QString().sprintf("Network Error: %d\n%s\n", status, reply->errorString().toUtf8().constData());
+        // the python thread must not wait for the dialog
+        Py_BEGIN_ALLOW_THREADS
         QMessageBox::warning(nullptr, "Error", errStr);
+        Py_END_ALLOW_THREADS
         Py_DecRef(_data);
         Py_DecRef(callback);
         return;
     }
-    PyObject *retVal = PyObject_CallFunction(callback, "sO", barray.constData(), _data);
+    PyObject *content = PyString_FromQByteArray(barray);
+    PyObject *retVal = content ? PyObject_CallFunctionObjArgs(callback, content, _data, nullptr) : nullptr;
+    Py_DecRef(content);
     Py_DecRef(_data);
     Py_DecRef(callback);
     RETURN_IF_ERROR(retVal)
@@ -171,7 +178,11 @@ static PyObject *warn(PyObject *, PyObject *args)
     const char *msg;
     if (!PyArg_ParseTuple(args, "s", &msg))
         return nullptr;
-    QMessageBox::warning(nullptr, "Warning", QString::fromUtf8(msg));
+    QString text = QString::fromUtf8(msg);
+    // let Python threads run while the dialog is shown
+    Py_BEGIN_ALLOW_THREADS
+    QMessageBox::warning(nullptr, "Warning", text);
+    Py_END_ALLOW_THREADS
     Py_IncRef(Py_None);
     return Py_None;
 }
@@ -181,7 +192,12 @@ static PyObject *question(PyObject *, PyObject *args)
     const char *msg;
     if (!PyArg_ParseTuple(args, "s", &msg))
         return nullptr;
-    if (QMessageBox::question(nullptr, "question", QString::fromUtf8(msg), QMessageBox::Yes, QMessageBox::No) == QMessageBox::Yes)
+    QString text = QString::fromUtf8(msg);
+    int answer;
+    Py_BEGIN_ALLOW_THREADS
+    answer = QMessageBox::question(nullptr, "question", text, QMessageBox::Yes, QMessageBox::No);
+    Py_END_ALLOW_THREADS
+    if (answer == QMessageBox::Yes)
     {
         Py_IncRef(Py_True);
         return Py_True;
@@ -236,8 +252,7 @@ static PyObject *show_detail(PyObject *, PyObject *args)
         PyErr_SetString(PyExc_TypeError, "The argument is not a dict.");
         return nullptr;
     }
-    QVariantHash data = PyObject_AsQVariant(dict).toHash();
-    res_library->openDetailPage(data);
+    res_library->openDetailPage(PyDictView(dict));
     Py_IncRef(Py_None);
     return Py_None;
 }
@@ -255,8 +270,7 @@ static PyObject *finish_parsing(PyObject *, PyObject *args)
         PyErr_SetString(PyExc_TypeError, "The argument is not a dict.");
         return nullptr;
     }
-    QVariantHash data = PyObject_AsQVariant(dict).toHash();
-    parser_webcatch->onParseFinished(data);
+    parser_webcatch->onParseFinished(PyDictView(dict));
     Py_IncRef(Py_None);
     return Py_None;
 }
@@ -295,6 +309,7 @@ static struct PyModuleDef moonplayerModule =
 #endif
 
 PyObject *apiModule = nullptr;
+static PyThreadState *mainThreadState = nullptr;
 
 void initPython()
 {
@@ -306,6 +321,9 @@ void initPython()
         qDebug("Cannot initialize python.");
         exit(-1);
     }
+#if PY_VERSION_HEX < 0x03070000
+    PyEval_InitThreads();
+#endif
 
     //init module
     geturl_obj = new GetUrl(qApp);
@@ -325,4 +343,16 @@ void initPython()
     PyRun_SimpleString("import sys");
     PyRun_SimpleString(QString("sys.path.insert(0, '%1/plugins')").arg(getAppPath()).toUtf8().constData());
     PyRun_SimpleString(QString("sys.path.append('%1/plugins')").arg(getUserPath()).toUtf8().constData());
+
+    // release the GIL, code called from Qt locks it with PyGILLocker
+    python_thread = new PythonThread;
+    mainThreadState = PyEval_SaveThread();
+}
+
+void finalizePython()
+{
+    delete python_thread;   // wait for the running task
+    python_thread = nullptr;
+    PyEval_RestoreThread(mainThreadState);
+    Py_Finalize();
 }
@@ -35,6 +35,7 @@ extern PyObject *exc_GetUrlError;
 ///////Module
 extern PyObject *apiModule;
 void initPython(void);
+void finalizePython(void);
 extern bool win_debug;
 
 #endif // PYAPI_H
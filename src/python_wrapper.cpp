@@ -43,7 +43,23 @@ QString PyString_AsQString(PyObject *pystr)
     if (PyUnicode_Check(pystr))
     {
 #if PY_MAJOR_VERSION >= 3
-        QString s = QString::fromUtf8(PyUnicode_AsUTF8(pystr));
+        // copy from its internal storage instead of converting to UTF-8 first
+        if (PyUnicode_READY(pystr) == -1)
+            return QString();
+        Py_ssize_t len = PyUnicode_GET_LENGTH(pystr);
+        void *data = PyUnicode_DATA(pystr);
+        QString s;
+        switch (PyUnicode_KIND(pystr))
+        {
+        case PyUnicode_1BYTE_KIND:
+            s = QString::fromLatin1((const char *) data, len);
+            break;
+        case PyUnicode_2BYTE_KIND:
+            s = QString::fromUtf16((const ushort *) data, len);
+            break;
+        default:
+            s = QString::fromUcs4((const uint *) data, len);
+        }
 #else
         PyObject *utf8str = PyUnicode_AsUTF8String(pystr);
         QString s = QString::fromUtf8(PyString_AsString(utf8str));
@@ -54,16 +70,38 @@ QString PyString_AsQString(PyObject *pystr)
 
     // Bytes
 #if PY_MAJOR_VERSION >= 3
+    else if (PyBytes_Check(pystr))
+        return QString::fromUtf8(PyBytes_AS_STRING(pystr), PyBytes_GET_SIZE(pystr));
     else if (PyByteArray_Check(pystr))
-        return QString::fromUtf8(PyByteArray_AsString(pystr));
+        return QString::fromUtf8(PyByteArray_AS_STRING(pystr), PyByteArray_GET_SIZE(pystr));
 #else
     else if (PyString_Check(pystr))
-        return QString::fromUtf8(PyString_AsString(pystr));
+        return QString::fromUtf8(PyString_AS_STRING(pystr), PyString_GET_SIZE(pystr));
 #endif
     else
         return QString();
 }
 
+/* Create a Python string, Py3's unicode is decoded from QString's UTF-16 data directly */
+PyObject *PyString_FromQString(const QString &str)
+{
+#if PY_MAJOR_VERSION >= 3
+    int byteorder = (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) ? -1 : 1;
+    return PyUnicode_DecodeUTF16((const char *) str.utf16(), str.size() * 2, "replace", &byteorder);
+#else
+    return PyString_FromQByteArray(str.toUtf8());
+#endif
+}
+
+PyObject *PyString_FromQByteArray(const QByteArray &utf8)
+{
+#if PY_MAJOR_VERSION >= 3
+    return PyUnicode_DecodeUTF8(utf8.constData(), utf8.size(), "replace");
+#else
+    return PyString_FromStringAndSize(utf8.constData(), utf8.size());
+#endif
+}
+
 /* Convert a Python object to a QVariant */
 QVariant PyObject_AsQVariant(PyObject *obj)
 {
@@ -120,7 +158,7 @@ QVariant PyObject_AsQVariant(PyObject *obj)
 
     // String
 #if PY_MAJOR_VERSION >= 3
-    else if (PyUnicode_Check(obj) || PyByteArray_Check(obj))
+    else if (PyUnicode_Check(obj) || PyBytes_Check(obj) || PyByteArray_Check(obj))
 #else
     else if (PyUnicode_Check(obj) || PyString_Check(obj))
 #endif
@@ -149,3 +187,57 @@ QStringList PyList_AsQStringList(PyObject *listobj)
     }
     return list;
 }
+
+
+/* Lazy access of a Python dict */
+PyDictView::PyDictView(PyObject *dict)
+{
+    this->dict = (dict && PyDict_Check(dict)) ? dict : nullptr;
+    Py_XINCREF(this->dict);
+}
+
+PyDictView::PyDictView(const PyDictView &other)
+{
+    dict = other.dict;
+    Py_XINCREF(dict);
+}
+
+PyDictView &PyDictView::operator=(const PyDictView &other)
+{
+    Py_XINCREF(other.dict);
+    Py_XDECREF(dict);
+    dict = other.dict;
+    return *this;
+}
+
+PyDictView::~PyDictView()
+{
+    Py_XDECREF(dict);
+}
+
+bool PyDictView::contains(const char *key) const
+{
+    return dict && PyDict_GetItemString(dict, key);
+}
+
+QVariant PyDictView::operator[](const char *key) const
+{
+    PyObject *value = dict ? PyDict_GetItemString(dict, key) : nullptr;
+    if (value == nullptr)
+        return QVariant();
+    return PyObject_AsQVariant(value);
+}
+
+QList<PyDictView> PyDictView::dictList(const char *key) const
+{
+    QList<PyDictView> result;
+    PyObject *list = dict ? PyDict_GetItemString(dict, key) : nullptr;
+    if (list == nullptr || !(PyList_Check(list) || PyTuple_Check(list)))
+        return result;
+    PyObject *seq = PySequence_Fast(list, "");
+    Py_ssize_t len = PySequence_Fast_GET_SIZE(seq);
+    for (Py_ssize_t i = 0; i < len; i++)
+        result << PyDictView(PySequence_Fast_GET_ITEM(seq, i));
+    Py_DecRef(seq);
+    return result;
+}
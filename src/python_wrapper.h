@@ -25,6 +25,18 @@
 #define PyString_FromString(str) PyUnicode_FromString(str)
 #endif
 
+// Hold the GIL in the current scope, it can be nested.
+// The main thread does not hold the GIL while running Qt's event loop, so Python threads can run,
+// and code called from Qt (not from Python) must lock it before using any Python API.
+class PyGILLocker
+{
+public:
+    inline PyGILLocker() { state = PyGILState_Ensure(); }
+    inline ~PyGILLocker() { PyGILState_Release(state); }
+private:
+    PyGILState_STATE state;
+};
+
 // Error handling
 QString fetchPythonException();
 void printPythonException();
@@ -34,7 +46,29 @@ void printPythonException();
 QString PyString_AsQString(PyObject *pystr);
 QStringList PyList_AsQStringList(PyObject *listobj);
 
+// Create a Python string (unicode in Py3), data can contain '\0'
+PyObject *PyString_FromQString(const QString &str);
+PyObject *PyString_FromQByteArray(const QByteArray &utf8);
+
 // Convert a Python object to a QVariant
 QVariant PyObject_AsQVariant(PyObject *obj);
 
+/* Read a Python dict without converting the whole dict, only the fields which are read are converted.
+ * It keeps a reference of the dict, and must be used in the thread which holds the GIL.
+ */
+class PyDictView
+{
+public:
+    explicit PyDictView(PyObject *dict = nullptr);
+    PyDictView(const PyDictView &other);
+    PyDictView &operator=(const PyDictView &other);
+    ~PyDictView();
+    bool contains(const char *key) const;
+    QVariant operator[](const char *key) const;
+    QList<PyDictView> dictList(const char *key) const;  // a list of dicts, e.g. streams
+
+private:
+    PyObject *dict;
+};
+
 #endif // PYTHON_WRAPPER_H
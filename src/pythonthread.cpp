@@ -0,0 +1,49 @@
+#include "pythonthread.h"
+#include "python_wrapper.h"
+#include <QMutexLocker>
+
+PythonThread *python_thread = nullptr;
+
+PythonThread::PythonThread(QObject *parent) : QThread(parent)
+{
+    quit = false;
+    start();
+}
+
+// the rest tasks are dropped
+PythonThread::~PythonThread()
+{
+    mutex.lock();
+    quit = true;
+    tasks.clear();
+    cond.wakeOne();
+    mutex.unlock();
+    wait();
+}
+
+void PythonThread::post(const std::function<void ()> &task)
+{
+    QMutexLocker locker(&mutex);
+    tasks.enqueue(task);
+    cond.wakeOne();
+}
+
+void PythonThread::run()
+{
+    forever
+    {
+        mutex.lock();
+        while (tasks.isEmpty() && !quit)
+            cond.wait(&mutex);
+        if (quit)
+        {
+            mutex.unlock();
+            return;
+        }
+        std::function<void ()> task = tasks.dequeue();
+        mutex.unlock();
+
+        PyGILLocker locker;
+        task();
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef PYTHONTHREAD_H
+#define PYTHONTHREAD_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+#include <functional>
+
+/* Run Python tasks in order in a dedicated thread, so long Python work does not block the GUI.
+ * Tasks hold the GIL while running. They must not call moonplayer's API or other objects
+ * of the main thread directly, results can be sent back by signals.
+ */
+
+class PythonThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit PythonThread(QObject *parent = nullptr);
+    ~PythonThread();
+    void post(const std::function<void ()> &task);
+
+protected:
+    void run(void);
+
+private:
+    QMutex mutex;
+    QWaitCondition cond;
+    QQueue<std::function<void ()> > tasks;
+    bool quit;
+};
+
+extern PythonThread *python_thread;
+
+#endif // PYTHONTHREAD_H
@@ -0,0 +1,131 @@
+#include "ratelimiter.h"
+#include "settings_network.h"
+#include <QTimer>
+
+#define TICK_INTERVAL   100             // ms
+#define MIN_RATE        (32 * 1024)     // lower bound of the rate limited for playback
+
+RateLimiter *rate_limiter = nullptr;
+
+RateLimiter::RateLimiter(QObject *parent) :
+    QObject(parent)
+{
+    globalTokens = 0;
+    playbackLimit = -1;
+    global_rate = task_rate = -1;
+    received = 0;
+    measured_rate = 0;
+    ticks = 0;
+    starving = false;
+    timer = new QTimer(this);
+    timer->setInterval(TICK_INTERVAL);
+    connect(timer, &QTimer::timeout, this, &RateLimiter::onTick);
+}
+
+
+// bytes per second, -1 if unlimited
+qint64 RateLimiter::globalRate()
+{
+    qint64 rate = Settings::maxSpeed > 0 ? (qint64) Settings::maxSpeed * 1024 : -1;
+    if (playbackLimit >= 0 && (rate < 0 || playbackLimit < rate))
+        rate = playbackLimit;
+    return rate;
+}
+
+
+// Bring the buckets into the range of a changed limit, so that neither a debt nor saved tokens
+// from another limit carry over
+void RateLimiter::updateLimits()
+{
+    qint64 rate = globalRate();
+    if (rate != global_rate)
+    {
+        global_rate = rate;
+        globalTokens = rate >= 0 ? qBound(-rate, globalTokens, rate / 2) : 0;
+    }
+    rate = Settings::maxTaskSpeed > 0 ? (qint64) Settings::maxTaskSpeed * 1024 : -1;
+    if (rate != task_rate)
+    {
+        task_rate = rate;
+        for (auto i = taskTokens.begin(); i != taskTokens.end(); i++)
+            i.value() = rate >= 0 ? qBound(-rate, i.value(), rate / 2) : 0;
+    }
+}
+
+
+qint64 RateLimiter::take(QObject *client, qint64 wanted)
+{
+    if (!timer->isActive())
+        timer->start();
+    updateLimits();
+    if (!taskTokens.contains(client))
+        taskTokens[client] = 0;
+
+    qint64 n = wanted;
+    if (global_rate >= 0)
+        n = qMin(n, qMax(globalTokens, (qint64) 0));
+    if (task_rate >= 0)
+        n = qMin(n, qMax(taskTokens[client], (qint64) 0));
+    consume(client, n);
+    return n;
+}
+
+
+// Only limited buckets are debited, the debt is at most one second of the rate
+void RateLimiter::consume(QObject *client, qint64 size)
+{
+    if (!timer->isActive())
+        timer->start();
+    updateLimits();
+    qint64 &tokens = taskTokens[client];
+    if (global_rate >= 0)
+        globalTokens = qMax(globalTokens - size, -global_rate);
+    if (task_rate >= 0)
+        tokens = qMax(tokens - size, -task_rate);
+    received += size;
+}
+
+
+void RateLimiter::remove(QObject *client)
+{
+    taskTokens.remove(client);
+    if (taskTokens.isEmpty())
+        timer->stop();
+}
+
+
+void RateLimiter::setPlaybackStarving(bool starving)
+{
+    this->starving = starving && Settings::playbackPriority;
+}
+
+
+void RateLimiter::onTick()
+{
+    // refill buckets, a bucket holds tokens for at most half a second
+    updateLimits();
+    if (global_rate >= 0)
+        globalTokens = qMin(globalTokens + global_rate * TICK_INTERVAL / 1000, qMax(global_rate / 2, (qint64) 1));
+    if (task_rate >= 0)
+    {
+        for (auto i = taskTokens.begin(); i != taskTokens.end(); i++)
+            i.value() = qMin(i.value() + task_rate * TICK_INTERVAL / 1000, qMax(task_rate / 2, (qint64) 1));
+    }
+
+    // adjust the limit for playback every second
+    if (++ticks == 1000 / TICK_INTERVAL)
+    {
+        ticks = 0;
+        measured_rate = received;
+        received = 0;
+        if (starving) // halve it
+            playbackLimit = qMax((playbackLimit < 0 ? measured_rate : qMin(playbackLimit, measured_rate)) / 2, (qint64) MIN_RATE);
+        else if (playbackLimit >= 0) // raise it slowly, remove it when downloads don't reach it
+        {
+            playbackLimit += playbackLimit / 4;
+            if (playbackLimit > measured_rate * 2)
+                playbackLimit = -1;
+        }
+    }
+    emit refilled();
+}
@@ -0,0 +1,49 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QObject>
+#include <QHash>
+class QTimer;
+
+/* Limit download speed with token buckets.
+ * Downloads take tokens before reading from QNetworkReply, and read the rest after refilled() is emitted.
+ * HLS segments are not throttled, they only consume tokens so that the measured rate covers all downloads.
+ * The global and per-task rates come from settings. If Settings::playbackPriority is set and the player
+ * is waiting for network data, the global rate is cut by half every second until the player recovers.
+ */
+
+class RateLimiter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RateLimiter(QObject *parent = nullptr);
+    qint64 take(QObject *client, qint64 wanted);    // returns the bytes allowed to read
+    void consume(QObject *client, qint64 size);     // read without limit, e.g. the rest data when finished
+    void remove(QObject *client);
+    void setPlaybackStarving(bool starving);
+    inline qint64 currentRate() { return measured_rate; }
+
+signals:
+    void refilled(void);
+
+private:
+    QTimer *timer;
+    QHash<QObject*, qint64> taskTokens;
+    qint64 globalTokens;
+    qint64 playbackLimit;   // -1 if not limited for playback
+    qint64 global_rate;     // limits the buckets are filled for, -1 if unlimited
+    qint64 task_rate;
+    qint64 received;
+    qint64 measured_rate;
+    int ticks;
+    bool starving;
+    qint64 globalRate(void);
+    void updateLimits(void);
+
+private slots:
+    void onTick(void);
+};
+
+extern RateLimiter *rate_limiter;
+
+#endif // RATELIMITER_H
@@ -158,7 +158,7 @@ void ResLibrary::clearItem()
     listWidget->clearItem();
 }
 
-void ResLibrary::openDetailPage(const QVariantHash &data)
+void ResLibrary::openDetailPage(const PyDictView &data)
 {
     if (detailView == nullptr)
     {
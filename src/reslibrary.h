@@ -9,6 +9,7 @@ class ResLibrary;
 }
 class MyListWidget;
 class DetailView;
+class PyDictView;
 
 //******************
 // ResLibrary
@@ -20,7 +21,7 @@ public:
     explicit ResLibrary(QWidget *parent = 0);
     void addItem(const QString &name, const QString &pic_url, const QString &flag);
     void clearItem(void);
-    void openDetailPage(const QVariantHash &data);
+    void openDetailPage(const PyDictView &data);
 
 private:
     Ui::ResLibrary *ui;
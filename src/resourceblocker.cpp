@@ -0,0 +1,82 @@
+#include "resourceblocker.h"
+#include "extractor.h"
+#include "settings_network.h"
+#include <QMutexLocker>
+#include <QWebEngineUrlRequestInfo>
+
+typedef QWebEngineUrlRequestInfo Info;
+
+// names used in settings and extractors' "allowed_resources"
+static const QHash<QString, int> typeNames = {
+    {"stylesheet", Info::ResourceTypeStylesheet},
+    {"script", Info::ResourceTypeScript},
+    {"image", Info::ResourceTypeImage},
+    {"font", Info::ResourceTypeFontResource},
+    {"object", Info::ResourceTypeObject},
+    {"media", Info::ResourceTypeMedia},
+    {"favicon", Info::ResourceTypeFavicon},
+    {"ping", Info::ResourceTypePing},
+    {"csp_report", Info::ResourceTypeCspReport},
+    {"plugin", Info::ResourceTypePluginResource}
+};
+
+ResourceBlocker::ResourceBlocker(QObject *parent) : QWebEngineUrlRequestInterceptor(parent)
+{
+}
+
+void ResourceBlocker::reset(const QStringList &allowedTypes)
+{
+    QMutexLocker locker(&mutex);
+    blockedTypes.clear();
+    foreach (QString name, Settings::blockedResources)
+    {
+        if (typeNames.contains(name) && !allowedTypes.contains(name))
+            blockedTypes << typeNames[name];
+    }
+    blockedHosts = Settings::blockedHosts.toSet();
+    counts.clear();
+}
+
+// "ads.example.com" is blocked by "example.com"
+bool ResourceBlocker::isBlockedHost(const QString &host)
+{
+    int i = 0;
+    while (i != -1)
+    {
+        if (blockedHosts.contains(host.mid(i)))
+            return true;
+        i = host.indexOf('.', i);
+        if (i != -1)
+            i++;
+    }
+    return false;
+}
+
+void ResourceBlocker::interceptRequest(QWebEngineUrlRequestInfo &info)
+{
+    QMutexLocker locker(&mutex);
+    int type = info.resourceType();
+    bool blocked = blockedTypes.contains(type) || isBlockedHost(info.requestUrl().host());
+    if (!blocked || Extractor::getMatchedExtractor(info.requestUrl().toString()))
+        return;
+    info.block(true);
+    counts[type]++;
+}
+
+int ResourceBlocker::blockedCount()
+{
+    QMutexLocker locker(&mutex);
+    int n = 0;
+    foreach (int count, counts)
+        n += count;
+    return n;
+}
+
+QString ResourceBlocker::summary()
+{
+    QMutexLocker locker(&mutex);
+    QStringList items;
+    for (auto i = counts.constBegin(); i != counts.constEnd(); i++)
+        items << QString("%1: %2").arg(typeNames.key(i.key(), "other"), QString::number(i.value()));
+    return items.join(", ");
+}
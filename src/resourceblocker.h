@@ -0,0 +1,33 @@
+#ifndef RESOURCEBLOCKER_H
+#define RESOURCEBLOCKER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QWebEngineUrlRequestInterceptor>
+
+/* Block resources which are not needed to catch the video's data in the web-catch browser,
+ * e.g. fonts, stylesheets, media and requests to ad or tracker hosts.
+ * Urls matching an extractor's pattern and resource types the extractor asks for are never blocked.
+ * interceptRequest() is called in Chromium's IO thread.
+ */
+
+class ResourceBlocker : public QWebEngineUrlRequestInterceptor
+{
+    Q_OBJECT
+public:
+    explicit ResourceBlocker(QObject *parent = nullptr);
+    void interceptRequest(QWebEngineUrlRequestInfo &info);
+    void reset(const QStringList &allowedTypes);   // start a new parse
+    int blockedCount(void);
+    QString summary(void);      // e.g. "stylesheet: 3, font: 2"
+
+private:
+    QMutex mutex;
+    QSet<int> blockedTypes;
+    QSet<QString> blockedHosts;
+    QHash<int, int> counts;     // blocked requests of each type
+    bool isBlockedHost(const QString &host);
+};
+
+#endif // RESOURCEBLOCKER_H
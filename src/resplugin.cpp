@@ -12,6 +12,7 @@ void initResPlugins()
 {
     static ResPlugin *array[128];
     resplugins = array;
+    PyGILLocker locker;
 
     QDir pluginsDir = QDir(getUserPath() + "/plugins");
     QStringList list = pluginsDir.entryList(QDir::Files, QDir::Name);
@@ -102,6 +103,7 @@ ResPlugin::ResPlugin(const QString &pluginName, bool *ok)
 
 ResPlugin::~ResPlugin()
 {
+    PyGILLocker locker;
     Py_DecRef(module);
     Py_DecRef(searchFunc);
     Py_DecRef(exploreFunc);
@@ -110,6 +112,7 @@ ResPlugin::~ResPlugin()
 
 void ResPlugin::explore(const QString &tag, const QString &country, int page)
 {
+    PyGILLocker locker;
     PyObject *retVal = PyObject_CallFunction(exploreFunc, "ssi",
                                              tag.toUtf8().constData(),
                                              country.toUtf8().constData(),
@@ -122,6 +125,7 @@ void ResPlugin::explore(const QString &tag, const QString &country, int page)
 
 void ResPlugin::search(const QString &key, int page)
 {
+    PyGILLocker locker;
     PyObject *retVal = PyObject_CallFunction(searchFunc, "si", key.toUtf8().constData(), page);
     if (retVal)
         Py_DecRef(retVal);
@@ -131,6 +135,7 @@ void ResPlugin::search(const QString &key, int page)
 
 void ResPlugin::loadItem(const QString &flag)
 {
+    PyGILLocker locker;
     PyObject *retVal = PyObject_CallFunction(loadItemFunc, "s", flag.toUtf8().constData());
     if (retVal)
         Py_DecRef(retVal);
@@ -2,6 +2,7 @@
 #define SETTINGS_NETWORK_H
 
 #include <QString>
+#include <QStringList>
 
 namespace Settings {
 extern QString proxyType;
@@ -9,7 +10,16 @@ extern QString proxy;
 extern QString downloadDir;
 extern int port;
 extern int maxTasks;
+extern int maxSpeed;
+extern int maxTaskSpeed;
 extern bool autoCombine;
+extern int combineWorkers;
+extern bool deleteParts;
+extern bool playbackPriority;
+extern bool adaptiveTasks;
+extern int maxHostTasks;
+extern QStringList blockedResources;
+extern QStringList blockedHosts;
 }
 
 #endif // SETTINGS_NETWORK_H
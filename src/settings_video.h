@@ -6,6 +6,7 @@
 namespace Settings {
 extern QString hwdec;
 extern bool copyMode;
+extern int decoderThreads;
 extern bool rememberUnfinished;
 }
 
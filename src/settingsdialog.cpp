@@ -24,6 +24,10 @@ QString Settings::downloadDir;
 QString Settings::danmakuFont;
 int Settings::port;
 int Settings::maxTasks;
+int Settings::maxSpeed;
+int Settings::maxTaskSpeed;
+int Settings::decoderThreads;
+int Settings::combineWorkers;
 int Settings::volume;
 int Settings::danmakuSize;
 int Settings::durationScrolling;
@@ -31,6 +35,12 @@ int Settings::durationStill;
 bool Settings::copyMode;
 bool Settings::rememberUnfinished;
 bool Settings::autoCombine;
+bool Settings::deleteParts;
+bool Settings::playbackPriority;
+bool Settings::adaptiveTasks;
+int Settings::maxHostTasks;
+QStringList Settings::blockedResources;
+QStringList Settings::blockedHosts;
 double Settings::danmakuAlpha;
 
 SettingsDialog *settingsDialog = nullptr;
@@ -71,10 +81,20 @@ void SettingsDialog::loadSettings()
     ui->proxyEdit->setText(proxy);
     ui->portEdit->setText(QString::number(port));
     ui->maxTaskSpinBox->setValue(maxTasks);
+    ui->maxSpeedSpinBox->setValue(maxSpeed);
+    ui->maxTaskSpeedSpinBox->setValue(maxTaskSpeed);
+    ui->playbackPriorityCheckBox->setChecked(playbackPriority);
+    ui->adaptiveTasksCheckBox->setChecked(adaptiveTasks);
+    ui->maxHostTasksSpinBox->setValue(maxHostTasks);
+    ui->blockedResourcesEdit->setText(blockedResources.join(", "));
+    ui->blockedHostsEdit->setText(blockedHosts.join(", "));
     ui->dirButton->setText(downloadDir);
     ui->rememberCheckBox->setChecked(rememberUnfinished);
     ui->combineCheckBox->setChecked(autoCombine);
+    ui->combineWorkersSpinBox->setValue(combineWorkers);
+    ui->deletePartsCheckBox->setChecked(deleteParts);
     ui->copyModeCheckBox->setChecked(copyMode);
+    ui->decoderThreadsSpinBox->setValue(decoderThreads);
 
     ui->alphaDoubleSpinBox->setValue(danmakuAlpha);
     ui->fontPushButton->setText(danmakuFont);
@@ -111,10 +131,20 @@ void SettingsDialog::saveSettings()
     proxy = ui->proxyEdit->text().simplified();
     port = ui->portEdit->text().toInt();
     maxTasks = ui->maxTaskSpinBox->value();
+    maxSpeed = ui->maxSpeedSpinBox->value();
+    maxTaskSpeed = ui->maxTaskSpeedSpinBox->value();
+    playbackPriority = ui->playbackPriorityCheckBox->isChecked();
+    adaptiveTasks = ui->adaptiveTasksCheckBox->isChecked();
+    maxHostTasks = ui->maxHostTasksSpinBox->value();
+    blockedResources = ui->blockedResourcesEdit->text().remove(' ').split(',', QString::SkipEmptyParts);
+    blockedHosts = ui->blockedHostsEdit->text().remove(' ').split(',', QString::SkipEmptyParts);
     downloadDir = ui->dirButton->text();
     rememberUnfinished = ui->rememberCheckBox->isChecked();
     autoCombine = ui->combineCheckBox->isChecked();
+    combineWorkers = ui->combineWorkersSpinBox->value();
+    deleteParts = ui->deletePartsCheckBox->isChecked();
     copyMode = ui->copyModeCheckBox->isChecked();
+    decoderThreads = ui->decoderThreadsSpinBox->value();
 
     danmakuAlpha = ui->alphaDoubleSpinBox->value();
     danmakuFont = ui->fontPushButton->text();
@@ -134,14 +164,24 @@ SettingsDialog::~SettingsDialog()
     settings.setValue("Player/remember_unfinished", rememberUnfinished);
     settings.setValue("Video/copy_mode", copyMode);
     settings.setValue("Video/hwdec", hwdec);
+    settings.setValue("Video/decoder_threads", decoderThreads);
     settings.setValue("Audio/out", aout);
     settings.setValue("Audio/volume", volume);
     settings.setValue("Net/proxy_type", proxyType);
     settings.setValue("Net/proxy", proxy);
     settings.setValue("Net/port", port);
     settings.setValue("Net/max_tasks", maxTasks);
+    settings.setValue("Net/max_speed", maxSpeed);
+    settings.setValue("Net/max_task_speed", maxTaskSpeed);
+    settings.setValue("Net/playback_priority", playbackPriority);
+    settings.setValue("Net/adaptive_tasks", adaptiveTasks);
+    settings.setValue("Net/max_host_tasks", maxHostTasks);
     settings.setValue("Net/download_dir", downloadDir);
     settings.setValue("Plugins/auto_combine", autoCombine);
+    settings.setValue("Plugins/combine_workers", combineWorkers);
+    settings.setValue("Plugins/delete_parts", deleteParts);
+    settings.setValue("Plugins/blocked_resources", blockedResources);
+    settings.setValue("Plugins/blocked_hosts", blockedHosts);
     settings.setValue("Danmaku/alpha", danmakuAlpha);
     settings.setValue("Danmaku/font", danmakuFont);
     settings.setValue("Danmaku/size", danmakuSize);
@@ -167,8 +207,21 @@ void initSettings()
     proxy = settings.value("Net/proxy").toString();
     port = settings.value("Net/port").toInt();
     maxTasks = settings.value("Net/max_tasks", 3).toInt();
+    maxSpeed = settings.value("Net/max_speed", 0).toInt();
+    maxTaskSpeed = settings.value("Net/max_task_speed", 0).toInt();
+    playbackPriority = settings.value("Net/playback_priority", true).toBool();
+    adaptiveTasks = settings.value("Net/adaptive_tasks", false).toBool();
+    maxHostTasks = settings.value("Net/max_host_tasks", 4).toInt();
     autoCombine = settings.value("Plugins/auto_combine", true).toBool();
+    combineWorkers = settings.value("Plugins/combine_workers", 0).toInt();
+    deleteParts = settings.value("Plugins/delete_parts", true).toBool();
+    blockedResources = settings.value("Plugins/blocked_resources",
+                                      QStringList() << "stylesheet" << "font" << "media" << "favicon" << "ping").toStringList();
+    blockedHosts = settings.value("Plugins/blocked_hosts",
+                                  QStringList() << "doubleclick.net" << "googlesyndication.com" << "google-analytics.com"
+                                                << "googletagmanager.com" << "hm.baidu.com" << "cnzz.com").toStringList();
     copyMode = settings.value("Video/copy_mode", false).toBool();
+    decoderThreads = settings.value("Video/decoder_threads", 0).toInt();
     danmakuAlpha = settings.value("Danmaku/alpha", 0.9).toDouble();
     danmakuFont = settings.value("Danmaku/font", "").toString();
     danmakuSize = settings.value("Danmaku/size", 0).toInt();
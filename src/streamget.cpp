@@ -1,106 +1,547 @@
 #include "streamget.h"
-#include <QMessageBox>
-#include <QProcess>
-#include <QTimer>
-#include <QUrl>
-#include "platform/paths.h"
+#include "accessmanager.h"
+#include "ratelimiter.h"
+#include "streammuxer.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QRegularExpression>
+#include <openssl/evp.h>
+
+#define MAX_CONNECTIONS   4
+#define MAX_RETRIES       3
 
 StreamGet::StreamGet(const QUrl &url, const QString &filename, QObject *parent) :
     DownloaderItem (filename, parent)
 {
-    args << "-y" << "-i" << url.toString() << "-c" << "copy" << "-bsf:a" << "aac_adtstoasc" << filename;
-    process = nullptr;
-    timer = nullptr;
-    duration = 0;
+    this->url = url;
+    this->filename = filename;
+    partsDir = QDir(filename + ".parts");
+    playlistReply = nullptr;
+    keyReply = nullptr;
+    muxer = nullptr;
+    finishedBytes = 0;
+    n_finished = 0;
+    prev_progress = 0;
+    is_paused = true;
 }
 
+StreamGet::~StreamGet()
+{
+    stop();
+}
+
+
+QNetworkReply *StreamGet::get(const QUrl &url, qint64 offset, qint64 length)
+{
+    QNetworkRequest request(url);
+    if (length >= 0)
+        request.setRawHeader("Range", QString("bytes=%1-%2").arg(offset).arg(offset + length - 1).toLatin1());
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    if (referer_table.contains(url.host()))
+        request.setRawHeader("Referer", referer_table[url.host()]);
+    return access_manager->get(request);
+}
+
+
 void StreamGet::start()
 {
-    process = new QProcess(this);
-    connect(process, SIGNAL(finished(int)), this, SLOT(onProcFinished(int)));
-    process->start(ffmpegFilePath(), args);
-    emit progressChanged(0, true);
-    timer = new QTimer(this);
-    connect(timer, &QTimer::timeout, this, &StreamGet::readOutput);
-    timer->start(1000);
+    if (muxer) // remuxing
+        return;
+    is_paused = false;
+    emit progressChanged(prev_progress, true);
+    if (segments.isEmpty()) // read playlist first
+    {
+        partsDir.mkpath(partsDir.absolutePath());
+        playlistReply = get(url);
+        connect(playlistReply, &QNetworkReply::finished, this, &StreamGet::onPlaylistFinished);
+    }
+    else
+        fetchNext();
 }
 
-void StreamGet::readOutput()
+
+void StreamGet::pause()
 {
-    QByteArray output = process->readAllStandardError();
-    if (duration == 0) // read duration first
+    if (muxer) // remuxing cannot be paused
+        return;
+    if (is_paused)
+        start();
+    else
     {
-        int i = output.indexOf("Duration: ");
-        if (i != -1)
+        abortAll();
+        is_paused = true;
+        emit paused((int) QNetworkReply::OperationCanceledError);
+    }
+}
+
+
+void StreamGet::stop()
+{
+    abortAll();
+    is_paused = true;
+    if (muxer)
+    {
+        // the muxer removes the incomplete output after it is cancelled
+        muxer->disconnect(this);
+        delete muxer;
+        muxer = nullptr;
+    }
+}
+
+
+void StreamGet::abortAll()
+{
+    QList<QNetworkReply*> replies = segmentReplies.keys();
+    if (playlistReply)
+        replies << playlistReply;
+    if (keyReply)
+        replies << keyReply;
+    foreach (QNetworkReply *reply, replies)
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    for (int i = 0; i < segments.size(); i++)
+        segments[i].fetching = false;
+    segmentReplies.clear();
+    receivedBytes.clear();
+    playlistReply = nullptr;
+    keyReply = nullptr;
+    rate_limiter->remove(this);
+}
+
+
+// Read master or media playlist
+void StreamGet::onPlaylistFinished()
+{
+    QNetworkReply *reply = playlistReply;
+    playlistReply = nullptr;
+    reply->deleteLater();
+    if (reply->error() != QNetworkReply::NoError)
+    {
+        qDebug("Fails to get playlist: %s", reply->errorString().toUtf8().constData());
+        is_paused = true;
+        emit paused((int) reply->error());
+        return;
+    }
+    QByteArray data = reply->readAll();
+    url = reply->url();
+
+    // master playlist, select the variant with the highest bandwidth
+    if (data.contains("#EXT-X-STREAM-INF"))
+    {
+        static QRegularExpression bandwidthRe("[:,]BANDWIDTH=(\\d+)");
+        QList<QByteArray> lines = data.split('\n');
+        qint64 bestBandwidth = -1;
+        QUrl bestUrl;
+        for (int i = 0; i < lines.size(); i++)
+        {
+            if (!lines[i].startsWith("#EXT-X-STREAM-INF:"))
+                continue;
+            qint64 bandwidth = bandwidthRe.match(QString::fromUtf8(lines[i])).captured(1).toLongLong();
+            // uri is in the next line which is not a comment
+            while (++i < lines.size() && (lines[i].trimmed().isEmpty() || lines[i].startsWith('#'))) {}
+            if (i < lines.size() && bandwidth > bestBandwidth)
+            {
+                bestBandwidth = bandwidth;
+                bestUrl = url.resolved(QUrl(QString::fromUtf8(lines[i].trimmed())));
+            }
+        }
+        if (bestUrl.isEmpty())
         {
-            int hh = output.mid(i+10, 2).toInt();
-            int mm = output.mid(i+13, 2).toInt();
-            int ss = output.mid(i+16, 2).toInt();
-            duration = hh * 3600 + mm * 60 + ss;
+            emit finished(this, true);
+            return;
         }
+        url = bestUrl;
+        playlistReply = get(url);
+        connect(playlistReply, &QNetworkReply::finished, this, &StreamGet::onPlaylistFinished);
+        return;
     }
-    else
+
+    // media playlist
+    parsePlaylist(data);
+    if (segments.isEmpty())
+    {
+        qDebug("No segments found in playlist: %s", url.toString().toUtf8().constData());
+        emit finished(this, true);
+        return;
+    }
+    readManifest();
+    updateProgress();
+    fetchNext();
+}
+
+
+void StreamGet::parsePlaylist(const QByteArray &data)
+{
+    static QRegularExpression attrRe("([A-Z0-9-]+)=(\"[^\"]*\"|[^,]*)");
+    QUrl keyUrl;
+    QByteArray keyIv;
+    qint64 sequence = 0;
+    qint64 rangeLength = -1, rangeOffset = -1;  // #EXT-X-BYTERANGE of the next segment
+    QHash<QUrl, qint64> rangeEnds;              // a sub-range without offset follows the previous one
+
+    foreach (QByteArray line, data.split('\n'))
+    {
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        // read attributes
+        QHash<QString, QString> attrs;
+        if (line.startsWith("#EXT-X-KEY:") || line.startsWith("#EXT-X-MAP:"))
+        {
+            QRegularExpressionMatchIterator i = attrRe.globalMatch(QString::fromUtf8(line.mid(line.indexOf(':') + 1)));
+            while (i.hasNext())
+            {
+                QRegularExpressionMatch match = i.next();
+                QString value = match.captured(2);
+                if (value.startsWith('"'))
+                    value = value.mid(1, value.length() - 2);
+                attrs[match.captured(1)] = value;
+            }
+        }
+
+        if (line.startsWith("#EXT-X-MEDIA-SEQUENCE:"))
+            sequence = line.mid(22).toLongLong();
+
+        else if (line.startsWith("#EXT-X-BYTERANGE:"))
+        {
+            if (!parseByteRange(line.mid(17), &rangeLength, &rangeOffset))
+            {
+                qDebug("Invalid byte range: %s", line.constData());
+                segments.clear();
+                return;
+            }
+        }
+
+        else if (line.startsWith("#EXT-X-KEY:"))
+        {
+            QString method = attrs["METHOD"];
+            if (method == "AES-128")
+            {
+                keyUrl = url.resolved(QUrl(attrs["URI"]));
+                keyIv = attrs.contains("IV") ? QByteArray::fromHex(attrs["IV"].mid(2).toLatin1()) : QByteArray();
+            }
+            else if (method == "NONE")
+                keyUrl.clear();
+            else
+            {
+                qDebug("Unsupported encryption method: %s", method.toUtf8().constData());
+                segments.clear();
+                return;
+            }
+        }
+
+        else if (line.startsWith("#EXT-X-MAP:")) // initialization section of fmp4 streams
+        {
+            Segment seg = {url.resolved(QUrl(attrs["URI"])), keyUrl, keyIv, 0, -1, -1, 0, false};
+            if (attrs.contains("BYTERANGE"))
+            {
+                if (!parseByteRange(attrs["BYTERANGE"].toLatin1(), &seg.length, &seg.offset))
+                {
+                    qDebug("Invalid byte range: %s", line.constData());
+                    segments.clear();
+                    return;
+                }
+                if (seg.offset < 0)
+                    seg.offset = 0;
+            }
+            segments << seg;
+        }
+
+        else if (!line.startsWith('#'))
+        {
+            // iv is the media sequence number if not specified
+            QByteArray iv = keyIv;
+            if (!keyUrl.isEmpty() && iv.isEmpty())
+            {
+                iv = QByteArray(16, 0);
+                for (int i = 0; i < 8; i++)
+                    iv[15 - i] = (char) ((sequence >> (i * 8)) & 0xff);
+            }
+            Segment seg = {url.resolved(QUrl(QString::fromUtf8(line))), keyUrl, iv, 0, -1, -1, 0, false};
+            if (rangeLength >= 0)
+            {
+                seg.offset = rangeOffset >= 0 ? rangeOffset : rangeEnds.value(seg.url, 0);
+                seg.length = rangeLength;
+                rangeEnds[seg.url] = seg.offset + seg.length;
+                rangeLength = rangeOffset = -1;
+            }
+            segments << seg;
+            sequence++;
+        }
+    }
+}
+
+
+// "<length>[@<offset>]", offset is -1 if not given
+bool StreamGet::parseByteRange(const QByteArray &spec, qint64 *length, qint64 *offset)
+{
+    QList<QByteArray> parts = spec.trimmed().split('@');
+    bool ok = true;
+    *length = parts[0].toLongLong(&ok);
+    if (!ok || *length <= 0 || parts.size() > 2)
+        return false;
+    *offset = -1;
+    if (parts.size() == 2)
     {
-        int i = output.lastIndexOf("time=");
-        if (i != -1)
+        *offset = parts[1].toLongLong(&ok);
+        if (!ok || *offset < 0)
+            return false;
+    }
+    return true;
+}
+
+
+/* Manifest format:
+ * first line is the url of media playlist, each following line is "index size" of a finished segment
+ */
+void StreamGet::readManifest()
+{
+    QFile file(partsDir.filePath("manifest.txt"));
+    if (file.open(QFile::ReadOnly | QFile::Text))
+    {
+        QByteArray playlistUrl = file.readLine().trimmed();
+        if (playlistUrl == url.toString().toUtf8())
         {
-            int hh = output.mid(i+5, 2).toInt();
-            int mm = output.mid(i+8, 2).toInt();
-            int ss = output.mid(i+11, 2).toInt();
-            int time = hh * 3600 + mm * 60 + ss;
-            emit progressChanged(time * 100 / duration, true);
+            while (!file.atEnd())
+            {
+                QList<QByteArray> parts = file.readLine().trimmed().split(' ');
+                int i = parts[0].toInt();
+                if (parts.size() != 2 || i < 0 || i >= segments.size() || segments[i].size >= 0)
+                    continue;
+                qint64 size = parts[1].toLongLong();
+                if (QFileInfo(partsDir.filePath(segmentName(i))).size() != size)
+                    continue;
+                segments[i].size = size;
+                finishedBytes += size;
+                n_finished++;
+            }
+            file.close();
+            if (n_finished)
+                qDebug("Resume stream download: %d / %d segments", n_finished, segments.size());
+            return;
         }
+        file.close();
+    }
+
+    // new download
+    if (file.open(QFile::WriteOnly | QFile::Text))
+    {
+        file.write(url.toString().toUtf8() + '\n');
+        file.close();
     }
 }
 
-void StreamGet::pause()
+void StreamGet::appendManifest(int index)
 {
-    QMessageBox::warning(nullptr, "Error", tr("Cannot pause the download of stream medias"));
+    QFile file(partsDir.filePath("manifest.txt"));
+    if (file.open(QFile::Append | QFile::Text))
+    {
+        file.write(QByteArray::number(index) + ' ' + QByteArray::number(segments[index].size) + '\n');
+        file.close();
+    }
 }
 
-void StreamGet::stop()
+
+// Start requests of the following segments
+void StreamGet::fetchNext()
 {
-    timer->stop();
-    if (process)
+    if (is_paused)
+        return;
+    if (n_finished == segments.size())
+    {
+        rate_limiter->remove(this);
+        remux();
+        return;
+    }
+    for (int i = 0; i < segments.size() && segmentReplies.size() < MAX_CONNECTIONS; i++)
     {
-        process->write("q");
-        process->waitForFinished(1000);
-        if (process->state() == QProcess::Running)
-            process->kill();
+        Segment &seg = segments[i];
+        if (seg.size >= 0 || seg.fetching)
+            continue;
+        if (!seg.keyUrl.isEmpty() && !keys.contains(seg.keyUrl)) // get key first
+        {
+            if (keyReply == nullptr)
+            {
+                keyReply = get(seg.keyUrl);
+                connect(keyReply, &QNetworkReply::finished, this, &StreamGet::onKeyFinished);
+            }
+            return;
+        }
+        QNetworkReply *reply = get(seg.url, seg.offset, seg.length);
+        connect(reply, &QNetworkReply::finished, this, &StreamGet::onSegmentFinished);
+        connect(reply, &QNetworkReply::downloadProgress, this, &StreamGet::onSegmentProgress);
+        segmentReplies[reply] = i;
+        seg.fetching = true;
     }
-    process->deleteLater();
-    process = nullptr;
-    timer->deleteLater();
-    timer = nullptr;
 }
 
-StreamGet::~StreamGet()
+
+void StreamGet::onKeyFinished()
 {
-    stop();
+    QNetworkReply *reply = keyReply;
+    keyReply = nullptr;
+    reply->deleteLater();
+    QByteArray key = reply->readAll();
+    if (reply->error() != QNetworkReply::NoError || key.size() != 16)
+    {
+        qDebug("Fails to get key: %s", reply->errorString().toUtf8().constData());
+        abortAll();
+        is_paused = true;
+        emit paused((int) reply->error());
+        return;
+    }
+    keys[reply->request().url()] = key;
+    fetchNext();
 }
 
-void StreamGet::onProcFinished(int code)
+
+void StreamGet::onSegmentFinished()
 {
-    timer->stop();
-    if (code) // Error
+    QNetworkReply *reply = static_cast<QNetworkReply*>(sender());
+    int i = segmentReplies.take(reply);
+    qint64 received = receivedBytes.take(reply);
+    reply->deleteLater();
+    Segment &seg = segments[i];
+    seg.fetching = false;
+
+    QByteArray data = reply->readAll();
+    if (data.size() > received)
+        rate_limiter->consume(this, data.size() - received);
+    bool rangeError = false;
+    if (reply->error() == QNetworkReply::NoError && seg.length >= 0)
+    {
+        // the server may ignore "Range" and send the whole resource
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 206 &&
+                data.size() >= seg.offset + seg.length)
+            data = data.mid(seg.offset, seg.length);
+        rangeError = (data.size() != seg.length);
+    }
+    if (rangeError)
+        qDebug("Wrong size of byte range: %s", seg.url.toString().toUtf8().constData());
+    else if (reply->error() == QNetworkReply::NoError && !seg.keyUrl.isEmpty() && !decrypt(data, keys[seg.keyUrl], seg.iv))
     {
-        QByteArray errOutput = process->readAllStandardError();
-        // audio filter does not match
-        if (errOutput.contains("Error initializing bitstream filter: aac_adtstoasc"))
+        qDebug("Fails to decrypt segment: %s", seg.url.toString().toUtf8().constData());
+        seg.retries = MAX_RETRIES;
+    }
+    else if (reply->error() == QNetworkReply::NoError)
+    {
+        // write to a temporary file first, so that an interrupted write is never taken as finished
+        QString name = partsDir.filePath(segmentName(i));
+        QFile file(name + ".part");
+        if (file.open(QFile::WriteOnly) && file.write(data) == data.size())
         {
-            args.removeOne("-bsf:a");
-            args.removeOne("aac_adtstoasc");
-            process->start(ffmpegFilePath(), args);
-            timer->start(1000);
+            file.close();
+            QFile::remove(name);
+            file.rename(name);
+            seg.size = data.size();
+            finishedBytes += seg.size;
+            n_finished++;
+            appendManifest(i);
+            updateProgress();
+            fetchNext();
             return;
         }
-        else // Other error
-            qDebug("%s", errOutput.constData());
+        qDebug("Fails to write: %s", name.toUtf8().constData());
+        seg.retries = MAX_RETRIES;
+    }
+
+    // error
+    seg.retries++;
+    if (seg.retries <= MAX_RETRIES)
+    {
+        fetchNext();
+        return;
+    }
+    qDebug("Fails to download segment: %s\n%s", seg.url.toString().toUtf8().constData(),
+           reply->errorString().toUtf8().constData());
+    seg.retries = 0;
+    abortAll();
+    is_paused = true;
+    emit paused((int) reply->error());
+}
+
+
+// Segments are not throttled, but their traffic is counted in the measured rate
+void StreamGet::onSegmentProgress(qint64 received, qint64)
+{
+    qint64 &prev = receivedBytes[static_cast<QNetworkReply*>(sender())];
+    if (received > prev)
+        rate_limiter->consume(this, received - prev);
+    prev = received;
+    updateProgress();
+}
+
+
+// The total size is estimated by the average size of finished segments
+void StreamGet::updateProgress()
+{
+    if (n_finished == 0)
+        return;
+    qint64 received = finishedBytes;
+    foreach (qint64 n, receivedBytes)
+        received += n;
+    qint64 total = finishedBytes * segments.size() / n_finished;
+    int progress = qMin(received * 100 / total, (qint64) 99);
+    if (progress != prev_progress)
+    {
+        prev_progress = progress;
+        emit progressChanged(progress, true);
     }
-    emit finished(this, code);
-    process->deleteLater();
-    process = nullptr;
-    timer->deleteLater();
-    timer = nullptr;
+}
+
+
+bool StreamGet::decrypt(QByteArray &data, const QByteArray &key, const QByteArray &iv)
+{
+    if (key.size() != 16 || iv.size() != 16)
+        return false;
+    QByteArray out(data.size() + 16, 0);
+    int len1 = 0, len2 = 0;
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    bool ok = EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), nullptr,
+                                 (const unsigned char*) key.constData(), (const unsigned char*) iv.constData()) &&
+              EVP_DecryptUpdate(ctx, (unsigned char*) out.data(), &len1,
+                                (const unsigned char*) data.constData(), data.size()) &&
+              EVP_DecryptFinal_ex(ctx, (unsigned char*) out.data() + len1, &len2);
+    EVP_CIPHER_CTX_free(ctx);
+    if (!ok)
+        return false;
+    out.resize(len1 + len2);
+    data = out;
+    return true;
+}
 
+
+// Remux segments into the output container.
+// The segments are read in place as one continuous stream, only one of them is open at a time.
+void StreamGet::remux()
+{
+    QStringList paths;
+    for (int i = 0; i < segments.size(); i++)
+        paths << partsDir.absoluteFilePath(segmentName(i));
+
+    setText(1, "Remux");
+    muxer = new StreamMuxer(paths, filename, StreamMuxer::JOIN, this);
+    connect(muxer, &StreamMuxer::progressChanged, this, [=](int percentage) {
+        setText(1, QString("Remux %1%").arg(percentage));
+    });
+    connect(muxer, &StreamMuxer::done, this, &StreamGet::onMuxFinished);
+    muxer->start();
+}
+
+
+void StreamGet::onMuxFinished(int status)
+{
+    if (status == StreamMuxer::OK) // clean up
+        partsDir.removeRecursively();
+    else
+        qDebug("Remux fails: %s", muxer->errorString().toUtf8().constData());
+    emit finished(this, status != StreamMuxer::OK);
+    muxer->deleteLater();
+    muxer = nullptr;
 }
@@ -2,8 +2,18 @@
 #define STREAMGET_H
 
 #include "downloaderitem.h"
-class QProcess;
-class QTimer;
+#include <QDir>
+#include <QHash>
+#include <QUrl>
+class QNetworkReply;
+class StreamMuxer;
+
+/* Download HLS streams in process.
+ * Segments are saved into a ".parts" directory next to the output file. Finished segments are
+ * recorded in a manifest, so the download can be paused and resumed. After all of them are
+ * downloaded, StreamMuxer reads the segments in place as one stream and remuxes them into
+ * the output file.
+ */
 
 class StreamGet : public DownloaderItem
 {
@@ -16,14 +26,50 @@ public:
     void stop();
 
 private:
-    QProcess *process;
-    QTimer *timer;
-    QStringList args;
-    int duration;
+    struct Segment
+    {
+        QUrl url;
+        QUrl keyUrl;        // Empty if the segment is not encrypted
+        QByteArray iv;
+        qint64 offset;      // Sub-range given by #EXT-X-BYTERANGE, length is -1 if the whole resource
+        qint64 length;
+        qint64 size;        // -1 if not finished
+        int retries;
+        bool fetching;
+    };
+    QList<Segment> segments;
+    QHash<QUrl, QByteArray> keys;
+    QHash<QNetworkReply*, int> segmentReplies;
+    QHash<QNetworkReply*, qint64> receivedBytes;
+    QNetworkReply *playlistReply;
+    QNetworkReply *keyReply;
+    StreamMuxer *muxer;
+    QUrl url;
+    QString filename;
+    QDir partsDir;
+    qint64 finishedBytes;
+    int n_finished;
+    int prev_progress;
+    bool is_paused;
+
+    QNetworkReply *get(const QUrl &url, qint64 offset = -1, qint64 length = -1);
+    void parsePlaylist(const QByteArray &data);
+    void readManifest(void);
+    void appendManifest(int index);
+    void fetchNext(void);
+    void abortAll(void);
+    void updateProgress(void);
+    void remux(void);
+    bool decrypt(QByteArray &data, const QByteArray &key, const QByteArray &iv);
+    static bool parseByteRange(const QByteArray &spec, qint64 *length, qint64 *offset);
+    inline QString segmentName(int i) { return QString::number(i) + ".ts"; }
 
 private slots:
-    void readOutput(void);
-    void onProcFinished(int code);
+    void onPlaylistFinished(void);
+    void onKeyFinished(void);
+    void onSegmentFinished(void);
+    void onSegmentProgress(qint64 received, qint64 total);
+    void onMuxFinished(int status);
 };
 
 #endif // STREAMGET_H
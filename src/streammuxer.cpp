@@ -0,0 +1,469 @@
+#include "streammuxer.h"
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#define IO_BUFFER_SIZE  65536
+
+// Files read one after another as one stream, only the current one is open
+struct JoinedFiles
+{
+    QStringList files;
+    QVector<qint64> starts;     // offset of each file in the stream, ended by the total size
+    int current;
+    qint64 pos;
+    QFile file;
+};
+
+static int readJoined(void *opaque, uint8_t *buf, int size)
+{
+    JoinedFiles *j = (JoinedFiles*) opaque;
+    while (j->current < j->files.size())
+    {
+        if (!j->file.isOpen())
+        {
+            j->file.setFileName(j->files[j->current]);
+            if (!j->file.open(QFile::ReadOnly) || !j->file.seek(j->pos - j->starts[j->current]))
+                return AVERROR(EIO);
+        }
+        qint64 n = j->file.read((char*) buf, size);
+        if (n < 0)
+            return AVERROR(EIO);
+        if (n > 0)
+        {
+            j->pos += n;
+            return n;
+        }
+        j->file.close();
+        j->current++;
+    }
+    return AVERROR_EOF;
+}
+
+static int64_t seekJoined(void *opaque, int64_t offset, int whence)
+{
+    JoinedFiles *j = (JoinedFiles*) opaque;
+    qint64 total = j->starts.last();
+    if (whence & AVSEEK_SIZE)
+        return total;
+    whence &= ~AVSEEK_FORCE;
+    if (whence == SEEK_CUR)
+        offset += j->pos;
+    else if (whence == SEEK_END)
+        offset += total;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+    if (offset < 0 || offset > total)
+        return AVERROR(EINVAL);
+    j->file.close();
+    j->pos = offset;
+    // the last file starting at or before offset, empty files are skipped
+    j->current = qMin(int(std::upper_bound(j->starts.begin(), j->starts.end(), offset) - j->starts.begin()) - 1,
+                      j->files.size());
+    return offset;
+}
+
+
+StreamMuxer::StreamMuxer(const QStringList &inputs, const QString &output, Mode mode, QObject *parent) :
+    QThread(parent)
+{
+    this->inputs = inputs;
+    this->output = output;
+    this->mode = mode;
+    start_us = end_us = -1;
+    out = nullptr;
+    joinedIo = nullptr;
+    joined = nullptr;
+    endTime = 0;
+    prev_progress = -1;
+    cancelled.store(0);
+}
+
+StreamMuxer::~StreamMuxer()
+{
+    cancel();
+    wait();
+}
+
+void StreamMuxer::setRange(qint64 start_us, qint64 end_us)
+{
+    this->start_us = start_us;
+    this->end_us = end_us;
+}
+
+void StreamMuxer::cancel()
+{
+    cancelled.store(1);
+}
+
+
+// cancelled is never reset here, cancel() may be called before the thread runs
+void StreamMuxer::run()
+{
+    endTime = 0;
+    prev_progress = -1;
+    int status = mux();
+    if (status == FAILED || status == CANCELLED)
+        QFile::remove(output);
+    if (status == FAILED)
+        qDebug("StreamMuxer: %s", error.toUtf8().constData());
+    emit done(status);
+}
+
+
+int StreamMuxer::mux()
+{
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();
+#endif
+    QList<Source> sources;
+    int status = prepare(sources);
+    if (status == OK)
+        status = copyPackets(sources);
+
+    // clean up
+    if (out)
+    {
+        if (!(out->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&out->pb);
+        avformat_free_context(out);
+        out = nullptr;
+    }
+    for (int i = 0; i < sources.size(); i++)
+        avformat_close_input(&sources[i].ctx);
+    if (joinedIo)
+    {
+        av_freep(&joinedIo->buffer);
+        avio_context_free(&joinedIo);
+    }
+    delete joined;
+    joined = nullptr;
+    return status;
+}
+
+
+// Input context which reads all inputs through one AVIOContext
+AVFormatContext *StreamMuxer::openJoined()
+{
+    joined = new JoinedFiles;
+    joined->files = inputs;
+    joined->current = 0;
+    joined->pos = 0;
+    qint64 total = 0;
+    foreach (QString file, inputs)
+    {
+        joined->starts << total;
+        total += QFileInfo(file).size();
+    }
+    joined->starts << total;
+
+    unsigned char *buffer = (unsigned char*) av_malloc(IO_BUFFER_SIZE);
+    if (buffer)
+        joinedIo = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, joined, readJoined, nullptr, seekJoined);
+    if (joinedIo == nullptr)
+    {
+        av_free(buffer);
+        return nullptr;
+    }
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (ctx)
+        ctx->pb = joinedIo;
+    return ctx;
+}
+
+
+// Open all files and write the header of output
+int StreamMuxer::prepare(QList<Source> &sources)
+{
+    // JOIN reads all inputs as the first one
+    foreach (QString file, mode == JOIN ? inputs.mid(0, 1) : inputs)
+    {
+        Source src;
+        src.ctx = (mode == JOIN) ? openJoined() : nullptr;
+        if ((mode == JOIN && src.ctx == nullptr) ||
+                avformat_open_input(&src.ctx, file.toUtf8().constData(), nullptr, nullptr) < 0)
+        {
+            error = "Cannot open " + file;
+            return FAILED;
+        }
+        sources << src;
+        if (avformat_find_stream_info(src.ctx, nullptr) < 0)
+        {
+            error = "Cannot read streams of " + file;
+            return FAILED;
+        }
+        src.base = src.ctx->start_time == AV_NOPTS_VALUE ? 0 : src.ctx->start_time;
+        src.pos = src.base;
+        src.size = src.ctx->pb ? qMax(avio_size(src.ctx->pb), (int64_t) 0) : 0;
+        src.eof = false;
+        sources.last() = src;
+    }
+    if (sources.isEmpty())
+    {
+        error = "No input";
+        return FAILED;
+    }
+
+    if (avformat_alloc_output_context2(&out, nullptr, nullptr, output.toUtf8().constData()) < 0)
+    {
+        error = "Unknown output format: " + output;
+        return FAILED;
+    }
+
+    // CONCAT creates output streams from the first input, MERGE creates them from all inputs
+    for (int i = 0; i < sources.size(); i++)
+    {
+        int status = mapStreams(sources[i], mode == MERGE || i == 0);
+        if (status != OK)
+            return status;
+    }
+
+    // seek to the keyframe before the start position, output starts from this keyframe
+    if (start_us >= 0)
+    {
+        Source &src = sources[0];
+        if (start_us > 0 && av_seek_frame(src.ctx, -1, src.base + start_us, AVSEEK_FLAG_BACKWARD) < 0)
+        {
+            error = "Cannot seek in " + inputs[0];
+            return FAILED;
+        }
+        src.base = AV_NOPTS_VALUE; // read from the first packet
+    }
+
+    if (!(out->oformat->flags & AVFMT_NOFILE) &&
+            avio_open(&out->pb, output.toUtf8().constData(), AVIO_FLAG_WRITE) < 0)
+    {
+        error = "Cannot write " + output;
+        return FAILED;
+    }
+    if (avformat_write_header(out, nullptr) < 0)
+    {
+        error = "Cannot write header of " + output;
+        return FAILED;
+    }
+    lastDts.fill(AV_NOPTS_VALUE, out->nb_streams);
+    return OK;
+}
+
+
+int StreamMuxer::mapStreams(Source &src, bool create)
+{
+    QVector<int> typeCount(AVMEDIA_TYPE_NB, 0);
+    src.map.fill(-1, src.ctx->nb_streams);
+
+    for (unsigned int i = 0; i < src.ctx->nb_streams; i++)
+    {
+        AVCodecParameters *par = src.ctx->streams[i]->codecpar;
+        if (par->codec_type != AVMEDIA_TYPE_VIDEO && par->codec_type != AVMEDIA_TYPE_AUDIO &&
+                par->codec_type != AVMEDIA_TYPE_SUBTITLE)
+            continue;
+
+        if (create)
+        {
+            // negative result means the muxer does not know, just try it
+            if (avformat_query_codec(out->oformat, par->codec_id, FF_COMPLIANCE_NORMAL) == 0)
+            {
+                if (par->codec_type == AVMEDIA_TYPE_SUBTITLE) // drop it
+                    continue;
+                error = QString("%1 cannot be stored in %2").arg(avcodec_get_name(par->codec_id), out->oformat->name);
+                return UNSUPPORTED_CODEC;
+            }
+            AVStream *stream = avformat_new_stream(out, nullptr);
+            if (stream == nullptr || avcodec_parameters_copy(stream->codecpar, par) < 0)
+            {
+                error = "Cannot create output stream";
+                return FAILED;
+            }
+            stream->codecpar->codec_tag = 0;
+            stream->time_base = src.ctx->streams[i]->time_base;
+            src.map[i] = stream->index;
+        }
+
+        else // the n-th stream of the same type in output
+        {
+            int n = typeCount[par->codec_type]++;
+            for (unsigned int j = 0; j < out->nb_streams; j++)
+            {
+                AVCodecParameters *outPar = out->streams[j]->codecpar;
+                if (outPar->codec_type == par->codec_type && n-- == 0)
+                {
+                    if (outPar->codec_id != par->codec_id)
+                    {
+                        error = "Clips are encoded with different codecs";
+                        return FAILED;
+                    }
+                    src.map[i] = j;
+                    break;
+                }
+            }
+        }
+    }
+    return OK;
+}
+
+
+int StreamMuxer::copyPackets(QList<Source> &sources)
+{
+    AVPacket *pkt = av_packet_alloc();
+    qint64 offset = 0;      // position of the current input in output, CONCAT only
+    qint64 totalSize = 0;
+    qint64 doneSize = 0;
+    int current = 0;
+    int status = OK;
+    for (int i = 0; i < sources.size(); i++)
+        totalSize += sources[i].size;
+
+    while (status == OK)
+    {
+        if (cancelled.load())
+        {
+            status = CANCELLED;
+            break;
+        }
+
+        // CONCAT reads the inputs in order, MERGE reads the input which is behind others
+        Source *src = nullptr;
+        if (mode != MERGE)
+        {
+            if (current == sources.size())
+                break;
+            src = &sources[current];
+        }
+        else
+        {
+            for (int i = 0; i < sources.size(); i++)
+            {
+                if (!sources[i].eof && (src == nullptr || sources[i].pos < src->pos))
+                    src = &sources[i];
+            }
+            if (src == nullptr)
+                break;
+        }
+
+        // end of file, read errors are also treated as the end like ffmpeg does
+        if (av_read_frame(src->ctx, pkt) < 0)
+        {
+            src->eof = true;
+            if (mode != MERGE)
+            {
+                doneSize += src->size;
+                offset = endTime;
+                current++;
+            }
+            continue;
+        }
+
+        AVRational tb = src->ctx->streams[pkt->stream_index]->time_base;
+        if (pkt->dts != AV_NOPTS_VALUE)
+        {
+            src->pos = av_rescale_q(pkt->dts, tb, AV_TIME_BASE_Q);
+            if (src->base == AV_NOPTS_VALUE)
+                src->base = src->pos;
+        }
+        if (src->base == AV_NOPTS_VALUE) // no timestamp yet after seeking
+        {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // cut the end
+        if (end_us >= 0 && pkt->pts != AV_NOPTS_VALUE)
+        {
+            qint64 t = av_rescale_q(pkt->pts, tb, AV_TIME_BASE_Q) - src->base;
+            qint64 length = end_us - qMax(start_us, (qint64) 0);
+            if (t > length + AV_TIME_BASE) // no more packets needed
+                src->eof = true;
+            if (t > length)
+            {
+                av_packet_unref(pkt);
+                if (src->eof && mode != MERGE)
+                    current++;
+                continue;
+            }
+        }
+
+        if (!writePacket(*src, pkt, offset))
+            status = FAILED;
+
+        // update progress
+        if (end_us >= 0)
+            updateProgress(endTime * 100 / qMax(end_us - qMax(start_us, (qint64) 0), (qint64) 1));
+        else if (totalSize > 0)
+        {
+            qint64 readSize = doneSize;
+            for (int i = mode != MERGE ? current : 0; i < (mode != MERGE ? current + 1 : sources.size()); i++)
+                readSize += sources[i].ctx->pb ? avio_tell(sources[i].ctx->pb) : 0;
+            updateProgress(readSize * 100 / totalSize);
+        }
+    }
+    av_packet_free(&pkt);
+
+    if (status == OK && av_write_trailer(out) < 0)
+    {
+        error = "Cannot write trailer of " + output;
+        status = FAILED;
+    }
+    return status;
+}
+
+
+bool StreamMuxer::writePacket(Source &src, AVPacket *pkt, qint64 offset)
+{
+    int index = pkt->stream_index < src.map.size() ? src.map[pkt->stream_index] : -1;
+    if (index < 0)
+    {
+        av_packet_unref(pkt);
+        return true;
+    }
+    AVRational in_tb = src.ctx->streams[pkt->stream_index]->time_base;
+    AVRational out_tb = out->streams[index]->time_base;
+
+    // move the input to its position in output
+    int64_t shift = av_rescale_q(offset - src.base, AV_TIME_BASE_Q, in_tb);
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts += shift;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts += shift;
+    av_packet_rescale_ts(pkt, in_tb, out_tb);
+
+    // dts must increase, which may be broken at the joints of clips
+    if (pkt->dts != AV_NOPTS_VALUE)
+    {
+        if (lastDts[index] != AV_NOPTS_VALUE && pkt->dts <= lastDts[index])
+        {
+            if (pkt->pts != AV_NOPTS_VALUE)
+                pkt->pts += lastDts[index] + 1 - pkt->dts;
+            pkt->dts = lastDts[index] + 1;
+        }
+        lastDts[index] = pkt->dts;
+    }
+    if (pkt->pts != AV_NOPTS_VALUE)
+        endTime = qMax(endTime, (qint64) av_rescale_q(pkt->pts + pkt->duration, out_tb, AV_TIME_BASE_Q));
+
+    pkt->stream_index = index;
+    pkt->pos = -1;
+    int ret = av_interleaved_write_frame(out, pkt);
+    av_packet_unref(pkt);
+    if (ret < 0)
+    {
+        char buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, buf, sizeof(buf));
+        error = QString("Cannot write packet: ") + buf;
+        return false;
+    }
+    return true;
+}
+
+
+void StreamMuxer::updateProgress(int progress)
+{
+    progress = qBound(0, progress, 100);
+    if (progress != prev_progress)
+    {
+        prev_progress = progress;
+        emit progressChanged(progress);
+    }
+}
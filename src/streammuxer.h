@@ -0,0 +1,76 @@
+#ifndef STREAMMUXER_H
+#define STREAMMUXER_H
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QStringList>
+#include <QVector>
+struct AVFormatContext;
+struct AVIOContext;
+struct AVPacket;
+struct JoinedFiles;
+
+/* Copy the packets of media files into one output file with libavformat, without re-encoding.
+ * CONCAT joins the inputs one after another, MERGE puts the streams of all inputs side by side
+ * (e.g. audio and video of dash streams), JOIN reads the inputs as consecutive pieces of one stream
+ * (e.g. segments of HLS streams) and keeps only one of them open at a time. Timestamps are shifted
+ * so that the output starts at 0 and never goes backward at the joints.
+ * If a stream cannot be stored in the output container, the muxer finishes with UNSUPPORTED_CODEC
+ * before writing anything, and the caller may transcode it with ffmpeg instead.
+ */
+
+class StreamMuxer : public QThread
+{
+    Q_OBJECT
+public:
+    enum Mode {CONCAT, MERGE, JOIN};
+    enum Status {OK, FAILED, UNSUPPORTED_CODEC, CANCELLED};
+
+    StreamMuxer(const QStringList &inputs, const QString &output, Mode mode = CONCAT, QObject *parent = nullptr);
+    ~StreamMuxer();
+    void setRange(qint64 start_us, qint64 end_us);  // cut a single input
+    void cancel(void);
+    inline QString errorString() { return error; }
+
+signals:
+    void progressChanged(int percentage);
+    void done(int status);
+
+protected:
+    void run(void);
+
+private:
+    struct Source
+    {
+        AVFormatContext *ctx;
+        QVector<int> map;       // input stream index -> output stream index, -1 if dropped
+        qint64 base;            // timestamp in AV_TIME_BASE to be moved to 0
+        qint64 pos;             // last dts in AV_TIME_BASE, used for interleaving
+        qint64 size;
+        bool eof;
+    };
+    QStringList inputs;
+    QString output;
+    Mode mode;
+    qint64 start_us;
+    qint64 end_us;
+    QAtomicInt cancelled;
+    QString error;
+
+    AVFormatContext *out;
+    AVIOContext *joinedIo;      // JOIN only
+    JoinedFiles *joined;
+    QVector<qint64> lastDts;    // in output time base
+    qint64 endTime;             // end of written packets in AV_TIME_BASE
+    int prev_progress;
+
+    int mux(void);
+    int prepare(QList<Source> &sources);
+    AVFormatContext *openJoined(void);
+    int mapStreams(Source &src, bool create);
+    int copyPackets(QList<Source> &sources);
+    bool writePacket(Source &src, AVPacket *pkt, qint64 offset);
+    void updateProgress(int progress);
+};
+
+#endif // STREAMMUXER_H
@@ -0,0 +1,219 @@
+#include "streamserver.h"
+#include "httpget.h"
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTcpSocket>
+#include <QUrl>
+
+#define CHUNK_SIZE      (256 * 1024)
+#define MAX_BUFFERED    (1024 * 1024)
+
+StreamServer::StreamServer(QObject *parent) :
+    QTcpServer(parent)
+{
+    n_tasks = 0;
+    if (!listen(QHostAddress::LocalHost))
+        qDebug("StreamServer: %s", errorString().toUtf8().constData());
+}
+
+
+QString StreamServer::addTask(HttpGet *task)
+{
+    QByteArray path;
+    for (auto i = tasks.constBegin(); i != tasks.constEnd(); i++)
+    {
+        if (i.value() == task)
+            path = i.key();
+    }
+    if (path.isEmpty())
+    {
+        path = '/' + QByteArray::number(n_tasks++) + '/' +
+                QUrl::toPercentEncoding(QFileInfo(task->fileName()).fileName());
+        tasks[path] = task;
+    }
+    return QString("http://127.0.0.1:%1%2").arg(QString::number(serverPort()), QString::fromUtf8(path));
+}
+
+
+HttpGet *StreamServer::task(const QByteArray &path)
+{
+    return tasks.value(path);
+}
+
+
+void StreamServer::incomingConnection(qintptr handle)
+{
+    QTcpSocket *socket = new QTcpSocket;
+    if (socket->setSocketDescriptor(handle))
+        new StreamConnection(socket, this);
+    else
+        delete socket;
+}
+
+
+
+StreamConnection::StreamConnection(QTcpSocket *socket, StreamServer *server) :
+    QObject(server)
+{
+    this->socket = socket;
+    this->server = server;
+    socket->setParent(this);
+    pos = 0;
+    end = -1;
+    header_sent = false;
+    waiting = false;
+    connect(socket, &QTcpSocket::readyRead, this, &StreamConnection::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &StreamConnection::sendData);
+    connect(socket, &QTcpSocket::disconnected, this, &StreamConnection::deleteLater);
+}
+
+
+// Read the request line and the "Range" header
+void StreamConnection::onReadyRead()
+{
+    if (task) // already handled, ignore other requests on this connection
+    {
+        socket->readAll();
+        return;
+    }
+    request += socket->readAll();
+    if (!request.contains("\r\n\r\n"))
+    {
+        if (request.size() > 8192)
+            sendError("400 Bad Request");
+        return;
+    }
+
+    QList<QByteArray> lines = request.split('\n');
+    QList<QByteArray> requestLine = lines[0].trimmed().split(' ');
+    if (requestLine.size() < 2 || (requestLine[0] != "GET" && requestLine[0] != "HEAD"))
+    {
+        sendError("405 Method Not Allowed");
+        return;
+    }
+    task = server->task(requestLine[1]);
+    file.setFileName(task ? task->fileName() : QString());
+    if (!task || !file.open(QFile::ReadOnly))
+    {
+        sendError("404 Not Found");
+        return;
+    }
+
+    static QRegularExpression rangeRe("^range:\\s*bytes=(\\d+)-(\\d*)", QRegularExpression::CaseInsensitiveOption);
+    foreach (QByteArray line, lines)
+    {
+        QRegularExpressionMatch match = rangeRe.match(QString::fromLatin1(line.trimmed()));
+        if (match.hasMatch())
+        {
+            pos = match.captured(1).toLongLong();
+            if (!match.captured(2).isEmpty())
+                end = match.captured(2).toLongLong() + 1;
+        }
+    }
+    connect(task.data(), &HttpGet::dataReady, this, &StreamConnection::sendData);
+    emit server->rangeWanted(task, pos);
+    sendData();
+}
+
+
+void StreamConnection::sendHeader()
+{
+    qint64 total = task->totalSize();
+    QByteArray header;
+    if (total < 0) // size is unknown, send the whole file without length
+    {
+        pos = 0;
+        header = "HTTP/1.1 200 OK\r\n"
+                 "Accept-Ranges: none\r\n";
+    }
+    else
+    {
+        if (end < 0 || end > total)
+            end = total;
+        if (pos >= end && pos > 0)
+        {
+            sendError("416 Range Not Satisfiable");
+            return;
+        }
+        if (pos == 0 && end == total)
+            header = "HTTP/1.1 200 OK\r\n";
+        else
+            header = "HTTP/1.1 206 Partial Content\r\n"
+                     "Content-Range: bytes " + QByteArray::number(pos) + '-' + QByteArray::number(end - 1) +
+                     '/' + QByteArray::number(total) + "\r\n";
+        header += "Accept-Ranges: bytes\r\n"
+                  "Content-Length: " + QByteArray::number(end - pos) + "\r\n";
+    }
+    header += "Content-Type: application/octet-stream\r\n"
+              "Connection: close\r\n\r\n";
+    socket->write(header);
+    header_sent = true;
+    if (request.startsWith("HEAD"))
+        socket->disconnectFromHost();
+}
+
+
+void StreamConnection::sendData()
+{
+    if (socket->state() != QTcpSocket::ConnectedState)
+        return;
+    if (!task) // download is deleted
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    if (!header_sent)
+    {
+        // wait until the size is known
+        if (task->totalSize() < 0 && task->availableSize(0) == 0 && !task->isComplete())
+            return;
+        sendHeader();
+        if (!header_sent || socket->state() != QTcpSocket::ConnectedState)
+            return;
+    }
+
+    // keep a small buffer in socket
+    while (socket->bytesToWrite() < MAX_BUFFERED)
+    {
+        if (end >= 0 && pos >= end)
+        {
+            socket->disconnectFromHost();
+            return;
+        }
+        qint64 available = task->availableSize(pos);
+        if (available == 0)
+        {
+            if (task->isComplete())
+                socket->disconnectFromHost();
+            else if (!waiting) // wait for HttpGet::dataReady
+            {
+                waiting = true;
+                emit server->rangeWanted(task, pos);
+            }
+            return;
+        }
+        waiting = false;
+        qint64 size = qMin(available, (qint64) CHUNK_SIZE);
+        if (end >= 0)
+            size = qMin(size, end - pos);
+        file.seek(pos);
+        QByteArray data = file.read(size);
+        if (data.isEmpty())
+        {
+            sendError("500 Internal Server Error");
+            return;
+        }
+        socket->write(data);
+        pos += data.size();
+    }
+}
+
+
+void StreamConnection::sendError(const QByteArray &status)
+{
+    if (!header_sent)
+        socket->write("HTTP/1.1 " + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    header_sent = true;
+    socket->disconnectFromHost();
+}
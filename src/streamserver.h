@@ -0,0 +1,62 @@
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+
+#include <QFile>
+#include <QHash>
+#include <QPointer>
+#include <QTcpServer>
+class HttpGet;
+class QTcpSocket;
+
+/* Serve files which are being downloaded by HttpGet on a loopback http server,
+ * so that they can be played before the download finishes.
+ * A request for data which has not arrived waits until HttpGet writes it.
+ */
+
+class StreamServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit StreamServer(QObject *parent = nullptr);
+    QString addTask(HttpGet *task);    // returns the url to play
+    HttpGet *task(const QByteArray &path);
+
+signals:
+    // a connection starts reading or waits for data at offset
+    void rangeWanted(HttpGet *task, qint64 offset);
+
+protected:
+    void incomingConnection(qintptr handle);
+
+private:
+    QHash<QByteArray, QPointer<HttpGet> > tasks;
+    int n_tasks;
+};
+
+
+// One request to StreamServer
+class StreamConnection : public QObject
+{
+    Q_OBJECT
+public:
+    StreamConnection(QTcpSocket *socket, StreamServer *server);
+
+private:
+    QTcpSocket *socket;
+    StreamServer *server;
+    QPointer<HttpGet> task;
+    QFile file;
+    QByteArray request;
+    qint64 pos;
+    qint64 end;     // -1 if the size is unknown
+    bool header_sent;
+    bool waiting;
+    void sendHeader(void);
+    void sendError(const QByteArray &status);
+
+private slots:
+    void onReadyRead(void);
+    void sendData(void);
+};
+
+#endif // STREAMSERVER_H
@@ -0,0 +1,276 @@
+#include "thumbnailer.h"
+#include "platform/paths.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#define THUMB_WIDTH         160
+#define COLUMNS             10
+#define MAX_THUMBNAILS      200
+#define MIN_INTERVAL        5       // seconds
+#define MAX_PACKETS         300     // give up a position if no frame is decoded after so many packets
+#define MAX_CACHED          100     // sprites kept on disk
+
+Thumbnailer::Thumbnailer(QObject *parent) : QThread(parent)
+{
+    interval = MIN_INTERVAL;
+    count = 0;
+    connect(this, &QThread::finished, this, &Thumbnailer::onFinished);
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    cancel();
+    wait();
+}
+
+void Thumbnailer::cancel()
+{
+    cancelled.store(1);
+}
+
+
+void Thumbnailer::load(const QString &file, int length)
+{
+    int new_interval = qMax(MIN_INTERVAL, (length + MAX_THUMBNAILS - 1) / MAX_THUMBNAILS);
+    if (file == this->file && new_interval == interval && (isReady() || isRunning()))
+        return;
+
+    cancel();
+    wait();
+    sprite = result = QImage();
+    this->file = file;
+    interval = new_interval;
+    count = length / interval + 1;
+
+    // only local videos, reading network streams would compete with the playback
+    QFileInfo fi(file);
+    if (length <= 0 || file.contains("://") || !fi.exists())
+        return;
+
+    QByteArray key = QString("%1|%2|%3|%4").arg(fi.absoluteFilePath(), QString::number(fi.size()),
+                                                QString::number(fi.lastModified().toMSecsSinceEpoch()),
+                                                QString::number(interval)).toUtf8();
+    QString hash = QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex();
+    cache_file = QDir(getUserPath()).filePath("thumbnails/" + hash + ".jpg");
+    if (sprite.load(cache_file, "JPG"))
+    {
+        emit ready();
+        return;
+    }
+
+    cancelled.store(0);
+    start(QThread::LowestPriority);
+}
+
+
+void Thumbnailer::onFinished()
+{
+    // a cancelled run may finish after a new one is started
+    if (isRunning() || cancelled.load() || result.isNull())
+        return;
+    sprite = result;
+    result = QImage();
+    emit ready();
+}
+
+
+QImage Thumbnailer::thumbnail(int pos) const
+{
+    if (sprite.isNull())
+        return QImage();
+    int i = qBound(0, pos / interval, count - 1);
+    int rows = (count + COLUMNS - 1) / COLUMNS;
+    int cell_w = sprite.width() / COLUMNS;
+    int cell_h = sprite.height() / rows;
+    return sprite.copy((i % COLUMNS) * cell_w, (i / COLUMNS) * cell_h, cell_w, cell_h);
+}
+
+
+void Thumbnailer::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    if (generate())
+        qDebug("Thumbnailer: %d thumbnails generated in %lld ms", count, timer.elapsed());
+}
+
+
+int Thumbnailer::interruptCallback(void *opaque)
+{
+    return ((Thumbnailer*) opaque)->cancelled.load();
+}
+
+
+bool Thumbnailer::generate()
+{
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();
+#endif
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (ctx == nullptr)
+        return false;
+    ctx->interrupt_callback.callback = interruptCallback;
+    ctx->interrupt_callback.opaque = this;
+    if (avformat_open_input(&ctx, file.toUtf8().constData(), nullptr, nullptr) < 0)
+        return false;
+    if (avformat_find_stream_info(ctx, nullptr) < 0)
+    {
+        avformat_close_input(&ctx);
+        return false;
+    }
+
+    // find video stream, cover arts of audio files are not worth it
+    int video = av_find_best_stream(ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video < 0 || (ctx->streams[video]->disposition & AV_DISPOSITION_ATTACHED_PIC))
+    {
+        avformat_close_input(&ctx);
+        return false;
+    }
+    for (unsigned i = 0; i < ctx->nb_streams; i++)
+        ctx->streams[i]->discard = ((int) i == video) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    AVStream *stream = ctx->streams[video];
+    AVCodecParameters *par = stream->codecpar;
+
+    // open decoder, only keyframes are decoded
+    const AVCodec *codec = avcodec_find_decoder(par->codec_id);
+    AVCodecContext *dec = codec ? avcodec_alloc_context3(codec) : nullptr;
+    if (dec == nullptr || avcodec_parameters_to_context(dec, par) < 0)
+    {
+        avcodec_free_context(&dec);
+        avformat_close_input(&ctx);
+        return false;
+    }
+    dec->skip_frame = AVDISCARD_NONKEY;
+    dec->skip_loop_filter = AVDISCARD_ALL;
+    dec->thread_count = 1;
+    if (avcodec_open2(dec, codec, nullptr) < 0)
+    {
+        avcodec_free_context(&dec);
+        avformat_close_input(&ctx);
+        return false;
+    }
+
+    // size of each thumbnail
+    qint64 width = par->width, height = par->height;
+    if (par->sample_aspect_ratio.num > 0 && par->sample_aspect_ratio.den > 0)
+        width = width * par->sample_aspect_ratio.num / par->sample_aspect_ratio.den;
+    if (width <= 0 || height <= 0)
+    {
+        avcodec_free_context(&dec);
+        avformat_close_input(&ctx);
+        return false;
+    }
+    int cell_w = THUMB_WIDTH;
+    int cell_h = qBound<qint64>(16, THUMB_WIDTH * height / width, THUMB_WIDTH * 2) & ~1;
+    int rows = (count + COLUMNS - 1) / COLUMNS;
+    QImage image(COLUMNS * cell_w, rows * cell_h, QImage::Format_RGB32);
+    image.fill(Qt::black);
+
+    SwsContext *sws = nullptr;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    int64_t prev_pts = AV_NOPTS_VALUE;
+    int prev = -1;
+    int n_decoded = 0;
+    for (int i = 0; i < count && !cancelled.load(); i++)
+    {
+        int64_t ts = av_rescale_q((int64_t) i * interval * AV_TIME_BASE, AV_TIME_BASE_Q, stream->time_base);
+        if (stream->start_time != AV_NOPTS_VALUE)
+            ts += stream->start_time;
+        if (av_seek_frame(ctx, video, ts, AVSEEK_FLAG_BACKWARD) < 0)
+            continue;
+        avcodec_flush_buffers(dec);
+        if (!decodeFrame(ctx, dec, video, pkt, frame))
+            continue;
+
+        int x = (i % COLUMNS) * cell_w;
+        int y = (i / COLUMNS) * cell_h;
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE && pts == prev_pts)
+        {
+            // keyframes are sparser than thumbnails here, reuse the previous one
+            int px = (prev % COLUMNS) * cell_w;
+            int py = (prev / COLUMNS) * cell_h;
+            for (int row = 0; row < cell_h; row++)
+                memcpy(image.scanLine(y + row) + x * 4, image.constScanLine(py + row) + px * 4, cell_w * 4);
+        }
+        else
+        {
+            sws = sws_getCachedContext(sws, frame->width, frame->height, (AVPixelFormat) frame->format,
+                                       cell_w, cell_h, AV_PIX_FMT_RGB32, SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (sws)
+            {
+                uint8_t *dst[4] = {image.scanLine(y) + x * 4, nullptr, nullptr, nullptr};
+                int dst_stride[4] = {image.bytesPerLine(), 0, 0, 0};
+                sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+            }
+        }
+        prev_pts = pts;
+        prev = i;
+        n_decoded++;
+        av_frame_unref(frame);
+    }
+    sws_freeContext(sws);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&dec);
+    avformat_close_input(&ctx);
+
+    if (cancelled.load() || n_decoded == 0)
+        return false;
+    result = image;
+
+    // save to cache
+    QDir dir(getUserPath());
+    dir.mkpath("thumbnails");
+    if (image.save(cache_file, "JPG", 80))
+        evictCache();
+    return true;
+}
+
+
+// Read packets until a frame comes out of the decoder
+bool Thumbnailer::decodeFrame(AVFormatContext *ctx, AVCodecContext *dec, int video, AVPacket *pkt, AVFrame *frame)
+{
+    int n_packets = 0;
+    while (n_packets < MAX_PACKETS && !cancelled.load() && av_read_frame(ctx, pkt) >= 0)
+    {
+        if (pkt->stream_index != video)
+        {
+            av_packet_unref(pkt);
+            continue;
+        }
+        n_packets++;
+        int ret = avcodec_send_packet(dec, pkt);
+        av_packet_unref(pkt);
+        if (ret < 0 && ret != AVERROR(EAGAIN))
+            return false;
+        if (avcodec_receive_frame(dec, frame) == 0)
+            return true;
+    }
+    // end of file, drain the decoder
+    if (n_packets < MAX_PACKETS && !cancelled.load())
+    {
+        avcodec_send_packet(dec, nullptr);
+        return avcodec_receive_frame(dec, frame) == 0;
+    }
+    return false;
+}
+
+
+// Remove the oldest sprites
+void Thumbnailer::evictCache()
+{
+    QDir dir(QDir(getUserPath()).filePath("thumbnails"));
+    QFileInfoList files = dir.entryInfoList(QStringList() << "*.jpg", QDir::Files, QDir::Time);
+    for (int i = MAX_CACHED; i < files.size(); i++)
+        QFile::remove(files[i].absoluteFilePath());
+}
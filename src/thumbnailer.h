@@ -0,0 +1,54 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QThread>
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+
+/* Generate a sprite sheet of thumbnails for the seek bar with a separate libavcodec decoder,
+ * which only decodes the keyframes nearest to evenly spaced positions. Sprites are cached on disk
+ * keyed by path, size and modification time, so previews of opened files are available at once.
+ * The player is never touched.
+ */
+
+class Thumbnailer : public QThread
+{
+    Q_OBJECT
+public:
+    explicit Thumbnailer(QObject *parent = nullptr);
+    ~Thumbnailer();
+    void load(const QString &file, int length);     // Load the cached sprite or generate it in background
+    void cancel(void);
+    QImage thumbnail(int pos) const;                 // Null if not ready
+    inline bool isReady(void) const { return !sprite.isNull(); }
+    inline QString currentFile(void) const { return file; }
+
+signals:
+    void ready(void);
+
+protected:
+    void run(void);
+
+private:
+    QString file;
+    QString cache_file;
+    int interval;       // seconds between thumbnails
+    int count;
+    QImage sprite;      // used in the main thread only
+    QImage result;      // written by run()
+    QAtomicInt cancelled;
+
+    bool generate(void);
+    bool decodeFrame(AVFormatContext *ctx, AVCodecContext *dec, int video, AVPacket *pkt, AVFrame *frame);
+    void evictCache(void);
+    static int interruptCallback(void *opaque);
+
+private slots:
+    void onFinished(void);
+};
+
+#endif // THUMBNAILER_H
@@ -1,7 +1,5 @@
 #include "utils.h"
 #include "accessmanager.h"
-#include <QDomDocument>
-#include <QDomElement>
 #include <QList>
 #include <QNetworkCookie>
 #include <QNetworkCookieJar>
@@ -25,26 +23,6 @@ QString secToTime(int second, bool use_format)
         return QString("%1:%2:%3").arg(hour, min, sec);
 }
 
-void readXspf(const QByteArray &xmlpage, QStringList &result)
-{
-    QDomDocument doc;
-    QDomElement elem;
-    QString title, location;
-    if (!doc.setContent(xmlpage))
-        return;
-    elem = doc.documentElement(); //<playlist>
-    elem = elem.firstChildElement("trackList"); //<tracklist>
-    elem = elem.firstChildElement("track"); //first <track>
-    while (!elem.isNull())
-    {
-        title = elem.firstChildElement("title").text();
-        location = elem.firstChildElement("location").text();
-        result << title;
-        result << location;
-        elem = elem.nextSiblingElement("track"); //next <track>
-    }
-}
-
 //save cookies to disk
 bool saveCookies(const QUrl &url, const QString &filename)
 {
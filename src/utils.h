@@ -9,9 +9,6 @@
 
 QString secToTime(int second, bool use_format = false);
 
-//Read .xspf playlists
-void readXspf(const QByteArray& xmlpage, QStringList& result);
-
 //Save cookies to disk
 bool saveCookies(const QUrl &url, const QString &filename);
 
@@ -1,59 +1,124 @@
 #include "videocombiner.h"
+#include "ffmpegjob.h"
+#include "streammuxer.h"
 #include <QMessageBox>
-#include "platform/paths.h"
 #include "playlist.h"
+#include "settings_network.h"
 
 VideoCombiner::VideoCombiner(QObject *parent, const QDir &dir) :
-    QProcess(parent)
+    QObject(parent)
 {
-    QStringList filelist = dir.entryList(QDir::Files, QDir::Name);
     this->dir = dir;
+    priority = 0;
+    input_size = 0;
+    cancelled = false;
+    muxer = nullptr;
+    transcoder = nullptr;
     QString ext = dir.absolutePath().section('.', -1);
     save_as = dir.absolutePath().section('.', 0, -2) + "(combine)." + ext;
-    QStringList args;
-
-
+    foreach (QString filename, dir.entryList(QDir::Files, QDir::Name))
+    {
+        if (filename.endsWith(".danmaku") || filename == "filelist.txt")
+            continue;
+        filelist << filename;
+        input_size += QFileInfo(dir.filePath(filename)).size();
+    }
     // this is a dash stream from youtube
-    if (filelist[0].startsWith("audio.") && filelist[1].startsWith("video."))
+    is_dash = filelist.size() == 2 && filelist[0].startsWith("audio.") && filelist[1].startsWith("video.");
+}
+
+void VideoCombiner::run()
+{
+    connect(this, SIGNAL(finished(int)), this, SLOT(onFinished(int)));
+    if (filelist.isEmpty())
     {
-        args << "-i" << filelist[1] << "-i" << filelist[0] << "-c:v" << "copy";
-        if (ext == "mp4")
-            args << "-c:a" << "aac";
-        else if (ext == "webm")
-            args << "-c:a" << "vorbis";
-        args << "-strict" << "experimental" << save_as;
+        emit finished(1);
+        return;
     }
 
+    QStringList files;
+    foreach (QString filename, filelist)
+        files << dir.filePath(filename);
+    if (is_dash)
+        muxer = new StreamMuxer(QStringList() << files[1] << files[0], save_as, StreamMuxer::MERGE, this);
     else
-    {
-        // Write list file
-        QFile file(dir.filePath("filelist.txt"));
-        if (!file.open(QFile::WriteOnly))
-        {
-            deleteLater();
-            return;
-        }
-        foreach (QString filename, filelist)
+        muxer = new StreamMuxer(files, save_as, StreamMuxer::CONCAT, this);
+    connect(muxer, &StreamMuxer::progressChanged, this, &VideoCombiner::progressChanged);
+    connect(muxer, &StreamMuxer::done, this, &VideoCombiner::onMuxFinished);
+    muxer->start(QThread::LowPriority);
+}
+
+void VideoCombiner::onMuxFinished(int status)
+{
+    if (status == StreamMuxer::UNSUPPORTED_CODEC && is_dash && !cancelled)
+        transcode();
+    else
+        emit finished(status == StreamMuxer::OK ? 0 : 1);
+}
+
+// Copy video and transcode audio with ffmpeg
+void VideoCombiner::transcode()
+{
+    QString ext = save_as.section('.', -1);
+    QStringList args;
+    args << "-y" << "-i" << filelist[1] << "-i" << filelist[0] << "-c:v" << "copy";
+    if (ext == "mp4")
+        args << "-c:a" << "aac";
+    else if (ext == "webm")
+        args << "-c:a" << "vorbis";
+    args << "-strict" << "experimental" << save_as;
+
+    transcoder = new FFmpegJob(this);
+    transcoder->setWorkingDirectory(dir.absolutePath());
+    connect(transcoder, &FFmpegJob::progressChanged, this, &VideoCombiner::progressChanged);
+    connect(transcoder, SIGNAL(finished(int)), this, SIGNAL(finished(int)));
+    // finished() is never emitted if ffmpeg cannot be started
+    connect(transcoder, &QProcess::errorOccurred, this, [=](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
         {
-            if (!filename.endsWith(".danmaku"))
-                file.write(QString("file '%1'\n").arg(filename).toUtf8());
+            qDebug("Cannot start ffmpeg: %s", transcoder->errorString().toUtf8().constData());
+            emit finished(1);
         }
-        file.close();
-        // Set arguments
-        args << "-f" << "concat" << "-safe" << "0" << "-i" << "filelist.txt" << "-c" << "copy" << save_as;
-    }
+    });
+    transcoder->start(args);
+}
 
-    // Run FFMPEG
-    setWorkingDirectory(dir.absolutePath());
-    connect(this, SIGNAL(finished(int)), this, SLOT(onFinished(int)));
-    start(ffmpegFilePath(), args, QProcess::ReadOnly);
+void VideoCombiner::cancel()
+{
+    cancelled = true;
+    if (transcoder && transcoder->state() != QProcess::NotRunning)
+        transcoder->kill();
+    else if (muxer && muxer->isRunning())
+        muxer->cancel();
+    else
+        deleteLater();
+}
+
+// Stream copy keeps the size nearly unchanged, a much smaller output means some clips are lost
+bool VideoCombiner::verify()
+{
+    QFileInfo info(save_as);
+    return info.exists() && info.size() >= input_size * 9 / 10;
+}
+
+void VideoCombiner::removeParts()
+{
+    foreach (QString filename, dir.entryList(QDir::Files))
+        dir.remove(filename);
+    QDir().rmdir(dir.absolutePath());
 }
 
 void VideoCombiner::onFinished(int status)
 {
-    if (status == 0)
+    if (cancelled)
+    {
+        QFile::remove(save_as);
+        deleteLater();
+        return;
+    }
+
+    if (status == 0 && verify())
     {
-        QMessageBox::information(nullptr, "Information", tr("Finished combining:") + save_as);
         // Copy .danmaku file
         QStringList nameFilter;
         nameFilter << "*.danmaku";
@@ -64,12 +129,16 @@ void VideoCombiner::onFinished(int status)
             newDanmakuFile = save_as + ".danmaku";
             QFile::copy(dir.filePath(danmakuFiles[0]), newDanmakuFile);
         }
+        if (Settings::deleteParts)
+            removeParts();
         playlist->addFile(QFileInfo(save_as).fileName(), save_as, newDanmakuFile);
+        QMessageBox::information(nullptr, "Information", tr("Finished combining:") + save_as);
     }
     else
     {
         QMessageBox::warning(nullptr, "Error", tr("Failed to combine:") + save_as);
-        qDebug("FFmpeg ERROR:\n%s", readAllStandardError().constData());
+        if (transcoder)
+            qDebug("FFmpeg ERROR:\n%s", transcoder->errorOutput().constData());
     }
     deleteLater();
 }
@@ -1,18 +1,47 @@
 #ifndef VIDEOCOMBINER_H
 #define VIDEOCOMBINER_H
 
-#include <QProcess>
+#include <QObject>
 #include <QDir>
+#include <QStringList>
+class FFmpegJob;
+class StreamMuxer;
 
-class VideoCombiner : public QProcess
+/* Combine the video clips in a directory.
+ * The job is created in queue and started by run(), see PostProcessor.
+ * Streams are copied by StreamMuxer, ffmpeg is only used to transcode audio which does not fit the container.
+ */
+
+class VideoCombiner : public QObject
 {
     Q_OBJECT
 public:
     explicit VideoCombiner(QObject *parent = 0, const QDir &dir = QDir());
+    void run(void);
+    void cancel(void);
+    inline QDir directory() { return dir; }
+    inline qint64 inputSize() { return input_size; }
+    int priority;
+
+signals:
+    void progressChanged(int percentage);
+    void finished(int status);
+
 private:
     QDir dir;
     QString save_as;
+    QStringList filelist;
+    qint64 input_size;
+    bool cancelled;
+    bool is_dash;
+    StreamMuxer *muxer;
+    FFmpegJob *transcoder;
+    void transcode(void);
+    bool verify(void);
+    void removeParts(void);
+
 private slots:
+    void onMuxFinished(int status);
     void onFinished(int status);
 };
 
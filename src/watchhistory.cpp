@@ -0,0 +1,172 @@
+#include "watchhistory.h"
+#include "platform/paths.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QUrl>
+
+#define MAX_ENTRIES        1000
+#define EVICT_INTERVAL     50      // Check the store size after every 50 insertions
+
+QHash<QString,QString> WatchHistory::origin_table;
+QStringList WatchHistory::origin_order;
+
+WatchHistory::WatchHistory()
+{
+    n_inserted = 0;
+    db = QSqlDatabase::addDatabase("QSQLITE", "watch_history");
+    db.setDatabaseName(QDir(getUserPath()).filePath("history.sqlite"));
+    ok = db.open();
+    if (!ok)
+    {
+        qDebug("[WatchHistory] Cannot open database: %s", db.lastError().text().toUtf8().constData());
+        return;
+    }
+
+    QSqlQuery query(db);
+    // WAL avoids rewriting the whole database file on every update
+    query.exec("PRAGMA journal_mode=WAL");
+    query.exec("PRAGMA synchronous=NORMAL");
+    ok = query.exec("CREATE TABLE IF NOT EXISTS history ("
+                    "uri TEXT PRIMARY KEY, "
+                    "position INTEGER NOT NULL, "
+                    "accessed INTEGER NOT NULL)");
+    if (!ok)
+    {
+        qDebug("[WatchHistory] Cannot create table: %s", query.lastError().text().toUtf8().constData());
+        return;
+    }
+    query.exec("CREATE INDEX IF NOT EXISTS history_accessed ON history(accessed)");
+    importLegacyFile();
+    evict();
+}
+
+WatchHistory::~WatchHistory()
+{
+    if (db.isOpen())
+        db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase("watch_history");
+}
+
+
+// Old versions save all positions into unfinished.txt when quitting
+void WatchHistory::importLegacyFile()
+{
+    QString filename = QDir(getUserPath()).filePath("unfinished.txt");
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly | QFile::Text))
+        return;
+    QStringList list = QString::fromUtf8(file.readAll()).split('\n');
+    file.close();
+
+    db.transaction();
+    for (int i = 0; i + 1 < list.size(); i += 2)
+        save(list[i], list[i + 1].toLongLong());
+    db.commit();
+    QFile::remove(filename);
+}
+
+
+/* Normalize uri so that the same video always gets the same key:
+ * local files are identified by their canonical path, parsed streams by the page they come from,
+ * other network streams by their url without query string, which usually contains expiring tokens.
+ */
+void WatchHistory::bindOrigin(const QString &streamUrl, const QString &origin)
+{
+    if (!origin_table.contains(streamUrl))
+        origin_order << streamUrl;
+    origin_table[streamUrl] = origin;
+    // bounded like the database, the oldest streams are unlikely to be played again
+    while (origin_order.size() > MAX_ENTRIES)
+        origin_table.remove(origin_order.takeFirst());
+}
+
+QString WatchHistory::normalize(const QString &uri)
+{
+    if (origin_table.contains(uri))
+        return origin_table[uri];
+
+    if (uri.startsWith("http://") || uri.startsWith("https://"))
+        return QUrl(uri).adjusted(QUrl::RemoveQuery | QUrl::RemoveFragment | QUrl::NormalizePathSegments).toString();
+
+    QFileInfo info(uri);
+    QString path = info.canonicalFilePath();
+    return path.isEmpty() ? info.absoluteFilePath() : path;
+}
+
+
+int64_t WatchHistory::position(const QString &uri)
+{
+    if (!ok)
+        return 0;
+    QString key = normalize(uri);
+    QSqlQuery query(db);
+    query.prepare("SELECT position FROM history WHERE uri = ?");
+    query.addBindValue(key);
+    if (!query.exec() || !query.next())
+        return 0;
+    int64_t pos = query.value(0).toLongLong();
+
+    // Mark as recently used
+    QSqlQuery touch(db);
+    touch.prepare("UPDATE history SET accessed = ? WHERE uri = ?");
+    touch.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    touch.addBindValue(key);
+    touch.exec();
+    return pos;
+}
+
+
+void WatchHistory::save(const QString &uri, int64_t pos)
+{
+    if (!ok || uri.isEmpty())
+        return;
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO history (uri, position, accessed) VALUES (?, ?, ?)");
+    query.addBindValue(normalize(uri));
+    query.addBindValue((qlonglong) pos);
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    if (!query.exec())
+    {
+        qDebug("[WatchHistory] Cannot save position: %s", query.lastError().text().toUtf8().constData());
+        return;
+    }
+    n_inserted++;
+    if (n_inserted % EVICT_INTERVAL == 0)
+        evict();
+}
+
+
+void WatchHistory::remove(const QString &uri)
+{
+    if (!ok)
+        return;
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM history WHERE uri = ?");
+    query.addBindValue(normalize(uri));
+    query.exec();
+}
+
+
+void WatchHistory::clear()
+{
+    if (!ok)
+        return;
+    QSqlQuery query(db);
+    query.exec("DELETE FROM history");
+}
+
+
+// Remove least recently used entries
+void WatchHistory::evict()
+{
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM history WHERE uri NOT IN "
+                  "(SELECT uri FROM history ORDER BY accessed DESC LIMIT ?)");
+    query.addBindValue(MAX_ENTRIES);
+    query.exec();
+}
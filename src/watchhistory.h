@@ -0,0 +1,39 @@
+#ifndef WATCHHISTORY_H
+#define WATCHHISTORY_H
+
+#include <QHash>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+/* Stores the playback positions of unfinished videos in a small SQLite database.
+ * Entries are written on each stop or file switch, read lazily when a file is opened,
+ * and the least recently used ones are evicted when the store grows too large.
+ */
+
+class WatchHistory
+{
+public:
+    WatchHistory();
+    ~WatchHistory();
+    int64_t position(const QString &uri);             // Return 0 if the uri is not in the history
+    void save(const QString &uri, int64_t pos);
+    void remove(const QString &uri);
+    void clear(void);
+
+    // Bind a parsed stream url with the page it comes from, so that resume works for online videos
+    static void bindOrigin(const QString &streamUrl, const QString &origin);
+    static QString normalize(const QString &uri);
+
+private:
+    QSqlDatabase db;
+    bool ok;
+    int n_inserted;
+
+    void importLegacyFile(void);
+    void evict(void);
+    static QHash<QString,QString> origin_table;
+    static QStringList origin_order;            // keys of origin_table, oldest first
+};
+
+#endif // WATCHHISTORY_H
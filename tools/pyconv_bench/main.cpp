@@ -0,0 +1,112 @@
+#include "python_wrapper.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <stdio.h>
+
+/* Compare the conversions in python_wrapper.cpp with the ones they replace,
+ * on payloads as large as those of plugins: a long page body and a parse result with many streams.
+ * A memoryview over a QByteArray is also measured as the zero-copy bound.
+ */
+
+#define BODY_SIZE       (8 * 1024 * 1024)   // characters
+#define N_STREAMS       5000
+#define ROUNDS          20
+
+static QString makeBody()
+{
+    QString unit = QString::fromUtf8("<div class=\"item\">视频 video 動画</div>\n");
+    QString body;
+    body.reserve(BODY_SIZE + unit.size());
+    while (body.size() < BODY_SIZE)
+        body += unit;
+    return body;
+}
+
+// {"title": ..., "streams": [{"format": ..., "urls": [...], "size": ...}, ...]}
+static PyObject *makeResult()
+{
+    PyObject *streams = PyList_New(N_STREAMS);
+    for (int i = 0; i < N_STREAMS; i++)
+    {
+        PyObject *urls = PyList_New(4);
+        for (int j = 0; j < 4; j++)
+            PyList_SET_ITEM(urls, j, PyString_FromQString(QString("https://example.com/%1/%2.mp4?token=abcdef").arg(i).arg(j)));
+        PyObject *stream = Py_BuildValue("{s:s,s:N,s:i}", "format", "1080p", "urls", urls, "size", i * 1000);
+        PyList_SET_ITEM(streams, i, stream);
+    }
+    return Py_BuildValue("{s:s,s:N}", "title", "A long video", "streams", streams);
+}
+
+static void report(const char *name, qint64 nsecs)
+{
+    printf("%-44s %10.3f ms\n", name, nsecs / 1e6 / ROUNDS);
+}
+
+int main()
+{
+    Py_Initialize();
+    QString body = makeBody();
+    QByteArray utf8 = body.toUtf8();
+    QElapsedTimer timer;
+    printf("body: %d characters, result: %d streams, average of %d rounds\n\n", body.size(), N_STREAMS, ROUNDS);
+
+    // QString -> Python string
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+        Py_DecRef(PyString_FromString(body.toUtf8().constData()));
+    report("QString -> str, via UTF-8 (old)", timer.nsecsElapsed());
+
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+        Py_DecRef(PyString_FromQString(body));
+    report("QString -> str, PyString_FromQString", timer.nsecsElapsed());
+
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+        Py_DecRef(PyMemoryView_FromMemory((char *) utf8.constData(), utf8.size(), PyBUF_READ));
+    report("QByteArray -> memoryview (zero-copy bound)", timer.nsecsElapsed());
+
+    // Python string -> QString
+    PyObject *pybody = PyString_FromQString(body);
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        PyObject *bytes = PyUnicode_AsUTF8String(pybody);
+        QString s = QString::fromUtf8(PyBytes_AsString(bytes));
+        Py_DecRef(bytes);
+    }
+    report("str -> QString, via UTF-8 (old)", timer.nsecsElapsed());
+
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+        PyString_AsQString(pybody);
+    report("str -> QString, PyString_AsQString", timer.nsecsElapsed());
+    Py_DecRef(pybody);
+
+    // read the title and the urls of the first stream from a parse result
+    PyObject *result = makeResult();
+    int n_urls = 0;
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        QVariantHash hash = PyObject_AsQVariant(result).toHash();
+        QString title = hash["title"].toString();
+        n_urls += hash["streams"].toList()[0].toHash()["urls"].toStringList().size();
+    }
+    report("dict -> QVariantHash, read 2 fields (old)", timer.nsecsElapsed());
+
+    timer.start();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        PyDictView view(result);
+        QString title = view["title"].toString();
+        n_urls += view.dictList("streams")[0]["urls"].toStringList().size();
+    }
+    report("dict -> PyDictView, read 2 fields", timer.nsecsElapsed());
+    Py_DecRef(result);
+
+    if (n_urls != ROUNDS * 8)
+        printf("\nunexpected result: %d urls\n", n_urls);
+    Py_Finalize();
+    return 0;
+}
@@ -0,0 +1,19 @@
+# Micro-benchmark of the conversions between Python and Qt in src/python_wrapper.cpp
+# Python 3 only. Build and run: qmake && make && ./pyconv_bench
+
+QT -= gui
+CONFIG += console c++11
+CONFIG -= app_bundle
+TARGET = pyconv_bench
+
+INCLUDEPATH += ../../src
+SOURCES += main.cpp \
+    ../../src/python_wrapper.cpp
+HEADERS += ../../src/python_wrapper.h
+
+unix {
+    CONFIG += link_pkgconfig
+    # python >= 3.8 needs the "-embed" package to link libpython
+    packagesExist(python3-embed): PKGCONFIG += python3-embed
+    else: PKGCONFIG += python3
+}